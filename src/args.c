@@ -33,6 +33,7 @@
 #include <limits.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
 #include <errno.h>
 #include <err.h>
 
@@ -41,6 +42,9 @@
 #include "args.h"
 
 static char *trim(const char *);
+static int32_t parse_date(const char *, time_t *);
+static int32_t parse_filter(const char *, struct args *);
+static int32_t parse_layout(const char *, int32_t *);
 
 /**
  * Parse the command line arguments.
@@ -55,7 +59,7 @@ args_parse(int32_t argc, char **argv, struct args *arguments)
 
 	int32_t opt = 0;
 	int32_t idx = 0;
-	char *sopts = "hVvo:s:t:r:R:";
+	char *sopts = "hVvo:s:t:r:R:f:u:n:c:z:SF:L:wi:J:C:D:";
 	static struct option lopts[] = {
 		{"help",         no_argument,       NULL, 'h'},
 		{"version",      no_argument,       NULL, 'V'},
@@ -65,12 +69,36 @@ args_parse(int32_t argc, char **argv, struct args *arguments)
 		{"offset",       required_argument, NULL, 't'},
 		{"reservation",  required_argument, NULL, 'r'},
 		{"rfile",        required_argument, NULL, 'R'},
+		{"from",         required_argument, NULL, 'f'},
+		{"to",           required_argument, NULL, 'u'},
+		{"threads",      required_argument, NULL, 'n'},
+		{"chunk",        required_argument, NULL, 'c'},
+		{"deflate",      required_argument, NULL, 'z'},
+		{"shuffle",      no_argument,       NULL, 'S'},
+		{"filter",       required_argument, NULL, 'F'},
+		{"layout",       required_argument, NULL, 'L'},
+		{"follow",       no_argument,       NULL, 'w'},
+		{"interval",     required_argument, NULL, 'i'},
+		{"json",         required_argument, NULL, 'J'},
+		{"cache",        required_argument, NULL, 'C'},
+		{"daemon",       required_argument, NULL, 'D'},
 		{NULL,           0,                 NULL,  0 }
 	};
 
 	/* Load the defaults for Jet first */
 	arguments->verbose = 0;
 	arguments->offset  = 0;
+	arguments->threads = 1;
+	arguments->follow  = 0;
+	arguments->interval = FOLLOW_INTERVAL;
+	arguments->from    = 0;
+	arguments->to      = 0;
+	arguments->chunk   = DEFAULT_CHUNK;
+	arguments->deflate = DEFAULT_DEFLATE;
+	arguments->shuffle = DEFAULT_SHUFFLE;
+	arguments->filter  = 0;
+	arguments->ncd     = 0;
+	arguments->layout  = ARGS_LAYOUT_COLUMNS;
 	arguments->stats_dir = xmalloc(strlen(MOAB_STATS_DIR)+1 * sizeof(char));
 	strcpy(arguments->stats_dir, MOAB_STATS_DIR);
 	arguments->res_file = xmalloc(strlen(RESERVATION_FILE)+1 * sizeof(char));
@@ -86,14 +114,16 @@ args_parse(int32_t argc, char **argv, struct args *arguments)
 				print_version();
 				break;
 			case 'v':
-				arguments->verbose = strtol(optarg, NULL, 10);
+				arguments->verbose += 1;
 				break;
 			case 'o':
+				free(arguments->output);
 				arguments->output = xmalloc((strlen(optarg)+1) *
 						  sizeof(char));
 				strcpy(arguments->output, optarg);
 				break;
 			case 's':
+				free(arguments->stats_dir);
 				arguments->stats_dir = xmalloc((strlen(optarg)+1) *
 						   sizeof(char));
 				strcpy(arguments->stats_dir, optarg);
@@ -102,18 +132,113 @@ args_parse(int32_t argc, char **argv, struct args *arguments)
 				arguments->offset = strtol(optarg, NULL, 10);
 				break;
 			case 'r':
+				free(arguments->res);
 				arguments->res = xmalloc((strlen(optarg)+1) *
 						   sizeof(char));
 				strcpy(arguments->res, optarg);
 				break;
 			case 'R':
+				free(arguments->res_file);
 				arguments->res_file = xmalloc((strlen(optarg)+1) *
 						   sizeof(char));
 				strcpy(arguments->res_file, optarg);
 				break;
+			case 'f':
+				if (parse_date(optarg, &arguments->from)) {
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'u':
+				if (parse_date(optarg, &arguments->to)) {
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'n':
+				arguments->threads = strtol(optarg, NULL, 10);
+				if (arguments->threads < 1) {
+					warnx("invalid number of threads: %s", optarg);
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'c':
+				arguments->chunk = strtoll(optarg, NULL, 10);
+				if (arguments->chunk < 0) {
+					warnx("invalid chunk size: %s", optarg);
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'z':
+				arguments->deflate = strtol(optarg, NULL, 10);
+				if (arguments->deflate < 0 || arguments->deflate > 9) {
+					warnx("invalid deflate level: %s", optarg);
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'S':
+				arguments->shuffle = 1;
+				break;
+			case 'F':
+				if (parse_filter(optarg, arguments)) {
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'L':
+				if (parse_layout(optarg, &arguments->layout)) {
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'w':
+				arguments->follow = 1;
+				break;
+			case 'i':
+				arguments->interval = strtol(optarg, NULL, 10);
+				if (arguments->interval < 1) {
+					warnx("invalid interval: %s", optarg);
+					return(EXIT_FAILURE);
+				}
+				break;
+			case 'J':
+				free(arguments->json);
+				arguments->json = xmalloc((strlen(optarg)+1) *
+						   sizeof(char));
+				strcpy(arguments->json, optarg);
+				break;
+			case 'C':
+				free(arguments->cache);
+				arguments->cache = xmalloc((strlen(optarg)+1) *
+						   sizeof(char));
+				strcpy(arguments->cache, optarg);
+				break;
+			case 'D':
+				free(arguments->daemon);
+				arguments->daemon = xmalloc((strlen(optarg)+1) *
+						   sizeof(char));
+				strcpy(arguments->daemon, optarg);
+				break;
 		}
 	}
 
+	/* A date range runs up to today unless told otherwise */
+	if (arguments->to && !arguments->from) {
+		warnx("--to requires --from");
+		return(EXIT_FAILURE);
+	}
+	if (arguments->from && !arguments->to) {
+		arguments->to = time(NULL);
+	}
+	if (arguments->from > arguments->to) {
+		warnx("--from is after --to");
+		return(EXIT_FAILURE);
+	}
+	if (arguments->follow && (arguments->from || arguments->offset)) {
+		warnx("--follow only reads the current day");
+		return(EXIT_FAILURE);
+	}
+	if (arguments->follow && arguments->layout == ARGS_LAYOUT_FLAT) {
+		warnx("--follow can not write the flat layout");
+		return(EXIT_FAILURE);
+	}
+
 	return(EXIT_SUCCESS);
 }
 /**
@@ -140,6 +265,18 @@ args_free(struct args *arguments)
 		free(arguments->res_file);
 		arguments->res_file = NULL;
 	}
+	if (arguments->json) {
+		free(arguments->json);
+		arguments->json = NULL;
+	}
+	if (arguments->cache) {
+		free(arguments->cache);
+		arguments->cache = NULL;
+	}
+	if (arguments->daemon) {
+		free(arguments->daemon);
+		arguments->daemon = NULL;
+	}
 
 	return(EXIT_SUCCESS);
 }
@@ -174,6 +311,101 @@ trim(const char *str)
 	return(new);
 }
 
+/**
+ * Parse a date of the form YYYY-MM-DD.
+ *
+ * @param[in]  str  The date string.
+ * @param[out] t    The start of the day (UTC).
+ * @retval     0    If the date was parsed.
+ * @retval     1    If the date is invalid.
+ **/
+static int32_t
+parse_date(const char *str, time_t *t)
+{
+	char *ptr    = NULL;
+	struct tm tm = {0};
+
+	ptr = strptime(str, "%Y-%m-%d", &tm);
+	if (ptr == NULL || *ptr != '\0') {
+		warnx("invalid date '%s', expected YYYY-MM-DD", str);
+		return(EXIT_FAILURE);
+	}
+	*t = timegm(&tm);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Parse a HDF5 filter of the form ID[,VALUE...].
+ *
+ * @param[in]  str       The filter string.
+ * @param[out] arguments The argument structure to fill in.
+ * @retval     0         If the filter was parsed.
+ * @retval     1         If the filter is invalid.
+ **/
+static int32_t
+parse_filter(const char *str, struct args *arguments)
+{
+	long v    = 0;
+	char *ptr = NULL;
+	const char *s = str;
+
+	v = strtol(s, &ptr, 10);
+	if (ptr == s || v <= 0 || v > INT32_MAX) {
+		goto rtn_err;
+	}
+	arguments->filter = v;
+	arguments->ncd    = 0;
+
+	while (*ptr == ',') {
+		s = ptr + 1;
+		if (arguments->ncd == ARGS_MAX_CD) {
+			warnx("too many values for filter, at most %d", ARGS_MAX_CD);
+			return(EXIT_FAILURE);
+		}
+		v = strtol(s, &ptr, 10);
+		if (ptr == s || v < 0 || v > UINT32_MAX) {
+			goto rtn_err;
+		}
+		arguments->cd[arguments->ncd++] = v;
+	}
+	if (*ptr != '\0') {
+		goto rtn_err;
+	}
+
+	return(EXIT_SUCCESS);
+
+rtn_err:
+	warnx("invalid filter '%s', expected ID[,VALUE...]", str);
+	return(EXIT_FAILURE);
+}
+
+/**
+ * Parse the name of an output layout.
+ *
+ * @param[in]  str       The layout name.
+ * @param[out] layout    The layout.
+ * @retval     0         If the layout was parsed.
+ * @retval     1         If the layout is unknown.
+ **/
+static int32_t
+parse_layout(const char *str, int32_t *layout)
+{
+	if (strcmp(str, "columns") == 0) {
+		*layout = ARGS_LAYOUT_COLUMNS;
+	} else if (strcmp(str, "compound") == 0) {
+		*layout = ARGS_LAYOUT_COMPOUND;
+	} else if (strcmp(str, "flat") == 0) {
+		*layout = ARGS_LAYOUT_FLAT;
+	} else {
+		warnx("invalid layout '%s', expected columns, compound or flat",
+		      str);
+		return(EXIT_FAILURE);
+	}
+
+	return(EXIT_SUCCESS);
+}
+
 /**
  * Print a short usage statement.
  **/
@@ -182,16 +414,43 @@ void
 print_usage(void)
 {
 	printf("\
-usage: %s [-h] [-V] [-v] [-s DIR] [-t OFFSET] [-r RES] [-R FILE] [-o output]\n\
+usage: %s [-h] [-V] [-v] [-s DIR] [-t OFFSET] [-f DATE [-u DATE]] [-n N]\n\
+          [-w [-i SECS]] [-D SOCKET]\n\
+          [-c N] [-z LEVEL] [-S] [-F ID[,VALUE...]] [-L LAYOUT]\n\
+          [-r RES] [-R FILE] [-o output] [-J FILE] [-C DIR]\n\
 \n\
   -h,   --help          Display this help and exit.\n\
   -V,   --version       Display version information and exit.\n\
   -v,   --verbose       Increase the verbosity level.\n\
+  -J,   --json          Write timings and counts as JSON to a file,\n\
+                        - for stdout.\n\
   -s,   --sdir          The MOAB statistics directory.\n\
   -t,   --offset        The offset in days from today to query.\n\
-  -r,   --reservation   A single reservation name to query.\n\
+  -f,   --from          The first day (YYYY-MM-DD) of a range to query.\n\
+  -u,   --to            The last day (YYYY-MM-DD) of a range to query.\n\
+  -n,   --threads       The number of threads to parse with, within and\n\
+                        across event logs.\n\
+  -w,   --follow        Follow the current day's event log as it grows.\n\
+  -i,   --interval      Seconds between writes when following.\n\
+  -D,   --daemon        Keep the events in memory, following the current\n\
+                        day's event log, and answer queries on a socket.\n\
+  -r,   --reservation   A single reservation name to query, written to\n\
+                        a new output that is then kept for it alone.\n\
   -R,   --rfile         A file containing all reservation names.\n\
   -o,   --outfile       A file to write output to.\n\
+  -C,   --cache         A directory to keep the records parsed from each\n\
+                        event log in, so unchanged logs are not parsed\n\
+                        again.\n\
+  -c,   --chunk         The dataset chunk size in elements.\n\
+  -z,   --deflate       The deflate (gzip) level, 1-9.\n\
+  -S,   --shuffle       Shuffle bytes before compressing.\n\
+  -F,   --filter        Another HDF5 filter id and its values.\n\
+  -L,   --layout        How events are stored: columns, a dataset for\n\
+                        each field (the default), compound, a single\n\
+                        dataset of records, or flat, one table of jobs\n\
+                        and one of reservations for the whole cluster.\n\
+                        The flat tables are rewritten on every write,\n\
+                        so they can not be followed.\n\
 \n", PROG_NAME);
 	exit(EXIT_FAILURE);
 }
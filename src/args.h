@@ -33,14 +33,39 @@ extern "C"
 {
 #endif
 
+/** Maximum number of values passed to a HDF5 filter **/
+#define ARGS_MAX_CD             8
+
+/** How the events of a group are laid out in the output **/
+enum args_layout {
+	ARGS_LAYOUT_COLUMNS = 0,        /* A dataset for each field */
+	ARGS_LAYOUT_COMPOUND,           /* A single dataset of records */
+	ARGS_LAYOUT_FLAT                /* Cluster-wide tables of columns */
+};
+
 /** Structure for holding the command line arguments **/
 struct args {
 	int32_t verbose;
 	int32_t offset;
+	int32_t threads;
+	int32_t follow;
+	int32_t interval;
+	time_t  from;
+	time_t  to;
+	int64_t chunk;
+	int32_t deflate;
+	int32_t shuffle;
+	int32_t filter;
+	int32_t ncd;
+	uint32_t cd[ARGS_MAX_CD];
+	int32_t layout;
 	char *output;
 	char *res;
 	char *stats_dir;
 	char *res_file;
+	char *json;
+	char *cache;
+	char *daemon;
 };
 
 /** Parse the command line options **/
@@ -59,6 +84,22 @@ void print_version(void);
 #define MOAB_STATS_DIR          "/misc/moab/moabhome/stats"
 #define RESERVATION_FILE        "/misc/moab/moabhome/etc/jet.reservations.cfg"
 
+/** Seconds between writes when following the event log **/
+#ifndef FOLLOW_INTERVAL
+#define FOLLOW_INTERVAL         60
+#endif
+
+/** Dataset storage defaults, may be overridden with CPPFLAGS **/
+#ifndef DEFAULT_CHUNK
+#define DEFAULT_CHUNK           0
+#endif
+#ifndef DEFAULT_DEFLATE
+#define DEFAULT_DEFLATE         0
+#endif
+#ifndef DEFAULT_SHUFFLE
+#define DEFAULT_SHUFFLE         0
+#endif
+
 /** Program name **/
 #if HAVE_GETPROGNAME
 #define PROG_NAME               getprogname()
@@ -82,6 +82,15 @@ extern "C"
 #  define ASSUME_ALIGNED
 #endif
 
+/**
+ * Mark a parameter as unused, as for a callback that ignores it.
+ **/
+#if defined(__GNUC__)
+#  define ATT_UNUSED       __attribute__((__unused__))
+#else
+#  define ATT_UNUSED
+#endif
+
 /**
  * Library visibility and compiler __attribute__ extensions
  **/
@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file cache.c
+ * Cache of the records parsed from each event log.
+ *
+ * Old event logs do not change, yet each run used to parse them in
+ * full. With a cache directory the records taken from a log are kept
+ * in a binary file of their own, keyed by the path, size and
+ * modification time of the log and the version of the records. A
+ * later run replays those records into the projects instead of
+ * parsing the log again.
+ *
+ * Every JOBEND naming a reservation and every RSVEND is kept, not
+ * only those of known projects, so the cache stays valid when the
+ * reservation file changes. The cache is local to a host, records
+ * are in its byte order.
+ *
+ * \ingroup cache
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <err.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "mem.h"
+#include "events.h"
+#include "projects.h"
+#include "cache.h"
+
+/** Written as is, so a cache of another byte order is not read **/
+#define CACHE_ORDER     0x01020304
+
+/** Bytes of the fields of an event **/
+#define CACHE_EVENT     (1 + 4 * sizeof(int64_t))
+
+/** Start of a cached event log **/
+struct cache_hdr {
+	char     magic[8];              /* CACHE_MAGIC */
+	uint32_t version;               /* CACHE_VERSION */
+	uint32_t order;                 /* CACHE_ORDER */
+	int32_t  ntypes;                /* Number of record types */
+	uint32_t npath;                 /* Length of the log's path */
+	int64_t  size;                  /* Size of the log */
+	int64_t  mtime;                 /* Modification time of the log */
+	int64_t  mtime_ns;              /* and its nanoseconds */
+	int64_t  ingested;              /* Bytes of the log ingested */
+	int64_t  lines;                 /* Lines read */
+	int64_t  bytes;                 /* Bytes read */
+	int64_t  other;                 /* Lines of no known record type */
+	int64_t  nrecs;                 /* Number of records */
+	uint64_t nbuf;                  /* Bytes of records */
+};
+/* Followed by the lines of each record type, the path and the records */
+
+/**
+ * Record an event taken from an event log.
+ *
+ * \param[in,out] l  The records of the log.
+ * \param[in] kind   The kind of record.
+ * \param[in] name   The reservation named by the record.
+ * \param[in] nlen   The length of the name.
+ * \param[in] e      The event, for CACHE_JOB and CACHE_RSV.
+ **/
+void
+cache_put(struct cache_log *l,
+	  int32_t kind,
+	  const char *name,
+	  size_t nlen,
+	  const struct event *e)
+{
+	int64_t v[4]   = {0};
+	char *ptr      = NULL;
+	uint16_t n     = (nlen > UINT16_MAX) ? UINT16_MAX : nlen;
+	size_t need    = 1 + sizeof(uint16_t) + n +
+			 ((kind == CACHE_JOB || kind == CACHE_RSV) ?
+			  CACHE_EVENT : 0);
+
+	if (l->n + need > l->cap) {
+		l->cap = l->cap ? l->cap * 2 : 1 << 16;
+		while (l->n + need > l->cap) {
+			l->cap *= 2;
+		}
+		l->buf = xrealloc(l->buf, l->cap);
+	}
+
+	ptr = l->buf + l->n;
+	*ptr++ = kind;
+	memcpy(ptr, &n, sizeof(uint16_t));
+	ptr += sizeof(uint16_t);
+	memcpy(ptr, name, n);
+	ptr += n;
+	if (kind == CACHE_JOB || kind == CACHE_RSV) {
+		*ptr++ = e->epoch;
+		v[0] = e->id;
+		v[1] = e->nodes;
+		v[2] = e->start;
+		v[3] = e->end;
+		memcpy(ptr, v, sizeof(v));
+		ptr += sizeof(v);
+	}
+	l->n = ptr - l->buf;
+	l->nrecs += 1;
+}
+
+/**
+ * Append the records of one log to another.
+ *
+ * \param[in,out] dst  The records to append to.
+ * \param[in] src      The records to append.
+ **/
+void
+cache_concat(struct cache_log *dst,
+	     const struct cache_log *src)
+{
+	if (dst->n + src->n > dst->cap) {
+		dst->cap = dst->n + src->n;
+		dst->buf = xrealloc(dst->buf, dst->cap);
+	}
+	if (src->n) {
+		memcpy(dst->buf + dst->n, src->buf, src->n);
+	}
+	dst->n     += src->n;
+	dst->nrecs += src->nrecs;
+}
+
+/**
+ * Free the records of an event log.
+ *
+ * \param[in,out] l  The records.
+ **/
+void
+cache_free(struct cache_log *l)
+{
+	if (l->buf) {
+		free(l->buf);
+	}
+	memset(l, 0, sizeof(struct cache_log));
+}
+
+/**
+ * Find the cache file of an event log.
+ *
+ * The file is named after the log, with a hash of the log's full
+ * path so logs of the same name in other directories do not clash.
+ *
+ * \param[in] dir    The cache directory.
+ * \param[in] path   The full path of the event log.
+ * \return           The cache filename, to be free()'ed.
+ **/
+static char *
+cache_name(const char *dir,
+	   const char *path)
+{
+	size_t n         = 0;
+	uint64_t h       = 14695981039346656037ULL;
+	const char *base = NULL;
+	const char *ptr  = NULL;
+	char *name       = NULL;
+
+	for (ptr = path; *ptr; ++ptr) {
+		h ^= (unsigned char)*ptr;
+		h *= 1099511628211ULL;
+	}
+	base = (ptr = strrchr(path, '/')) ? ptr + 1 : path;
+
+	n = strlen(dir) + strlen(base) + 32;
+	name = xmalloc(n * sizeof(char));
+	snprintf(name, n, "%s/%s.%016llx%s", dir, base, (unsigned long long)h,
+		 CACHE_SUFFIX);
+
+	return(name);
+}
+
+/**
+ * Check that a buffer holds whole records.
+ *
+ * \param[in] buf    The records.
+ * \param[in] n      The bytes of records.
+ * \param[in] nrecs  The number of records expected.
+ * \retval 0         If the records are whole.
+ * \retval 1         If they are not.
+ **/
+static int32_t
+cache_check(const char *buf,
+	    size_t n,
+	    int64_t nrecs)
+{
+	int32_t kind    = 0;
+	uint16_t nlen   = 0;
+	const char *end = buf + n;
+
+	while (buf < end) {
+		if ((size_t)(end - buf) < 1 + sizeof(uint16_t)) {
+			return(EXIT_FAILURE);
+		}
+		kind = *buf++;
+		memcpy(&nlen, buf, sizeof(uint16_t));
+		buf += sizeof(uint16_t) + nlen;
+		if (kind == CACHE_JOB || kind == CACHE_RSV) {
+			buf += CACHE_EVENT;
+		} else if (kind < CACHE_JOB || kind > CACHE_RSV_BAD) {
+			return(EXIT_FAILURE);
+		}
+		nrecs -= 1;
+	}
+
+	return((buf == end && nrecs == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * Replay records into the projects of a parser.
+ *
+ * Each record is counted as event_job() or event_rsv() would have
+ * counted the line it came from.
+ *
+ * \param[in] buf    The records, already checked.
+ * \param[in] n      The bytes of records.
+ * \param[in,out] ps The parser state holding the projects.
+ **/
+static void
+cache_replay(const char *buf,
+	     size_t n,
+	     struct parser *ps)
+{
+	int32_t kind      = 0;
+	uint16_t nlen     = 0;
+	int64_t v[4]      = {0};
+	const char *name  = NULL;
+	const char *end   = buf + n;
+	struct event e    = {0};
+	struct project *p = NULL;
+
+	while (buf < end) {
+		kind = *buf++;
+		memcpy(&nlen, buf, sizeof(uint16_t));
+		name = buf + sizeof(uint16_t);
+		buf = name + nlen;
+		p = project_find(ps->index, name, nlen);
+
+		switch (kind) {
+			case CACHE_JOB:
+			case CACHE_RSV:
+				e.epoch = *buf++;
+				memcpy(v, buf, sizeof(v));
+				buf += sizeof(v);
+				e.id    = v[0];
+				e.nodes = v[1];
+				e.start = v[2];
+				e.end   = v[3];
+				if (p == NULL) {
+					ps->counts.unmatched += (kind == CACHE_JOB);
+				} else if (kind == CACHE_JOB) {
+					columns_append(&p->jobs, &e);
+					ps->counts.jobs += 1;
+				} else {
+					project_add_rsv(p, &e);
+					ps->counts.rsvs += 1;
+				}
+				break;
+			case CACHE_JOB_NONE:
+			case CACHE_JOB_BAD:
+				if (p == NULL) {
+					ps->counts.unmatched += 1;
+				} else {
+					ps->counts.malformed += (kind == CACHE_JOB_BAD);
+				}
+				break;
+			case CACHE_RSV_BAD:
+				ps->counts.malformed += (p != NULL);
+				break;
+		}
+	}
+}
+
+/**
+ * Replay the cached records of an event log.
+ *
+ * The cache is only used if it was written for this log as it is now,
+ * by this version of the parser.
+ *
+ * \param[in] dir        The cache directory.
+ * \param[in] filename   The event log.
+ * \param[in] sb         The status of the open event log.
+ * \param[out] offset    The bytes of the log ingested.
+ * \param[in,out] ps     The parser state holding the projects.
+ * \retval 0             If the records were replayed.
+ * \retval 1             If there is no usable cache.
+ **/
+int32_t
+cache_load(const char *dir,
+	   const char *filename,
+	   const struct stat *sb,
+	   off_t *offset,
+	   struct parser *ps)
+{
+	int32_t ierr        = EXIT_FAILURE;
+	int32_t i           = 0;
+	FILE *ifp           = NULL;
+	char *path          = NULL;
+	char *name          = NULL;
+	char *buf           = NULL;
+	struct cache_hdr h  = {{0}};
+	int64_t types[EVENT_TYPES];
+
+	if ((path = realpath(filename, NULL)) == NULL) {
+		return(EXIT_FAILURE);
+	}
+	name = cache_name(dir, path);
+	if ((ifp = fopen(name, "r")) == NULL) {
+		goto rtn_err;
+	}
+
+	if (fread(&h, sizeof(struct cache_hdr), 1, ifp) != 1      ||
+	    memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+	    h.version  != CACHE_VERSION                            ||
+	    h.order    != CACHE_ORDER                              ||
+	    h.ntypes   != EVENT_TYPES                              ||
+	    h.size     != sb->st_size                              ||
+	    h.mtime    != sb->st_mtim.tv_sec                       ||
+	    h.mtime_ns != sb->st_mtim.tv_nsec                      ||
+	    h.npath    != strlen(path)) {
+		goto rtn_err;
+	}
+	/* Ask for a byte more than is left, to catch a longer file */
+	buf = xmalloc(h.npath + h.nbuf + 1);
+	if (fread(types, sizeof(types), 1, ifp) != 1                    ||
+	    fread(buf, 1, h.npath + h.nbuf + 1, ifp) != h.npath + h.nbuf ||
+	    memcmp(buf, path, h.npath) != 0                             ||
+	    cache_check(buf + h.npath, h.nbuf, h.nrecs) != 0) {
+		goto rtn_err;
+	}
+
+	ps->counts.lines += h.lines;
+	ps->counts.bytes += h.bytes;
+	ps->counts.other += h.other;
+	for (i = 0; i < EVENT_TYPES; ++i) {
+		ps->counts.types[i] += types[i];
+	}
+	cache_replay(buf + h.npath, h.nbuf, ps);
+	*offset = h.ingested;
+	ierr = EXIT_SUCCESS;
+
+rtn_err:
+	if (ifp) {
+		fclose(ifp);
+		ifp = NULL;
+	}
+	free(buf);
+	free(name);
+	free(path);
+	return(ierr);
+}
+
+/**
+ * Write the records parsed from an event log to the cache.
+ *
+ * The cache file is written under another name and renamed, so a
+ * reader never sees a partial file.
+ *
+ * \param[in] dir        The cache directory.
+ * \param[in] filename   The event log.
+ * \param[in] sb         The status of the event log when it was parsed.
+ * \param[in] offset     The bytes of the log ingested.
+ * \param[in] before     The parser counters before the log was parsed.
+ * \param[in] ps         The parser state holding the records.
+ * \retval 0             If the cache was written.
+ * \retval 1             If there was an error.
+ **/
+int32_t
+cache_save(const char *dir,
+	   const char *filename,
+	   const struct stat *sb,
+	   off_t offset,
+	   const struct counters *before,
+	   const struct parser *ps)
+{
+	int32_t ierr        = EXIT_FAILURE;
+	int32_t i           = 0;
+	FILE *ofp           = NULL;
+	char *path          = NULL;
+	char *name          = NULL;
+	char *tmp           = NULL;
+	struct cache_hdr h  = {{0}};
+	int64_t types[EVENT_TYPES];
+
+	if ((path = realpath(filename, NULL)) == NULL) {
+		warn("unable to cache %s", filename);
+		return(EXIT_FAILURE);
+	}
+	name = cache_name(dir, path);
+	tmp = xmalloc(strlen(name) + 5);
+	sprintf(tmp, "%s.tmp", name);
+
+	memcpy(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	h.version  = CACHE_VERSION;
+	h.order    = CACHE_ORDER;
+	h.ntypes   = EVENT_TYPES;
+	h.npath    = strlen(path);
+	h.size     = sb->st_size;
+	h.mtime    = sb->st_mtim.tv_sec;
+	h.mtime_ns = sb->st_mtim.tv_nsec;
+	h.ingested = offset;
+	h.lines    = ps->counts.lines - before->lines;
+	h.bytes    = ps->counts.bytes - before->bytes;
+	h.other    = ps->counts.other - before->other;
+	h.nrecs    = ps->log->nrecs;
+	h.nbuf     = ps->log->n;
+	for (i = 0; i < EVENT_TYPES; ++i) {
+		types[i] = ps->counts.types[i] - before->types[i];
+	}
+
+	if ((ofp = fopen(tmp, "w")) == NULL) {
+		warn("unable to write cache %s", tmp);
+		goto rtn_err;
+	}
+	if (fwrite(&h, sizeof(struct cache_hdr), 1, ofp) != 1 ||
+	    fwrite(types, sizeof(types), 1, ofp) != 1        ||
+	    fwrite(path, 1, h.npath, ofp) != h.npath         ||
+	    fwrite(ps->log->buf, 1, h.nbuf, ofp) != h.nbuf) {
+		warn("unable to write cache %s", tmp);
+		goto rtn_err;
+	}
+	if (fclose(ofp) != 0) {
+		ofp = NULL;
+		warn("unable to write cache %s", tmp);
+		goto rtn_err;
+	}
+	ofp = NULL;
+	if (rename(tmp, name) != 0) {
+		warn("unable to rename cache %s", tmp);
+		goto rtn_err;
+	}
+	ierr = EXIT_SUCCESS;
+
+rtn_err:
+	if (ofp) {
+		fclose(ofp);
+		ofp = NULL;
+	}
+	if (ierr) {
+		unlink(tmp);
+	}
+	free(tmp);
+	free(name);
+	free(path);
+	return(ierr);
+}
+
+/**
+ * \}
+ **/
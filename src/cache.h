@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file cache.h
+ * Cache of the records parsed from each event log.
+ *
+ * \ingroup cache
+ * \{
+ **/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Version of the cached records, bump it when the parser changes
+ * what it takes from a record
+ **/
+#define CACHE_VERSION   1
+
+/** Tag at the start of a cached event log **/
+#define CACHE_MAGIC     "KRESLOG"
+
+/** Suffix of a cached event log **/
+#define CACHE_SUFFIX    ".krc"
+
+/** Kinds of record kept in a cache **/
+enum cache_kind {
+	CACHE_JOB = 1,                  /* A JOBEND with all its fields */
+	CACHE_JOB_NONE,                 /* A JOBEND missing a field */
+	CACHE_JOB_BAD,                  /* A JOBEND with a malformed field */
+	CACHE_RSV,                      /* A RSVEND with all its fields */
+	CACHE_RSV_BAD                   /* A RSVEND with a malformed field */
+};
+
+/** The records taken from an event log, encoded one after another.
+ * Each is its kind and the reservation it names, followed by the
+ * event for CACHE_JOB and CACHE_RSV.
+ **/
+struct cache_log {
+	size_t  n;                      /* Bytes used */
+	size_t  cap;                    /* Bytes allocated */
+	int64_t nrecs;                  /* Number of records */
+	char    *buf;
+};
+
+struct stat;
+struct event;
+struct counters;
+struct parser;
+
+/** Record an event taken from an event log **/
+void cache_put(struct cache_log *, int32_t, const char *, size_t,
+	       const struct event *);
+
+/** Append the records of one log to another **/
+void cache_concat(struct cache_log *, const struct cache_log *);
+
+/** Replay the cached records of an event log **/
+int32_t cache_load(const char *, const char *, const struct stat *, off_t *,
+		   struct parser *);
+
+/** Write the records parsed from an event log to the cache **/
+int32_t cache_save(const char *, const char *, const struct stat *, off_t,
+		   const struct counters *, const struct parser *);
+
+/** Free the records of an event log **/
+void cache_free(struct cache_log *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* CACHE_H */
+/**
+ * \}
+ **/
@@ -0,0 +1,578 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file decomp.c
+ * Streaming decompression of archived event logs.
+ *
+ * A compressed event log is decompressed on a thread of its own into
+ * a pipe, the parser reads the other end as it would a plain stream.
+ * Decompression and parsing so overlap and nothing is written to disk.
+ *
+ * \ingroup decomp
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "config.h"
+#if HAVE_ZLIB_H && HAVE_LIBZ
+#include <zlib.h>
+#endif
+#if HAVE_LZMA_H && HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "mem.h"
+#include "decomp.h"
+
+/** A compression format, how to recognise it and its name **/
+struct format {
+	int32_t fmt;
+	const char *ext;                /* Filename extension */
+	const char *magic;              /* Leading bytes */
+	size_t nmagic;
+	const char *name;
+};
+
+/** Known compression formats **/
+static const struct format formats[] = {
+	{DECOMP_GZIP, ".gz",  "\x1f\x8b",             2, "gzip"},
+	{DECOMP_XZ,   ".xz",  "\xfd" "7zXZ\x00",      6, "xz"},
+	{DECOMP_ZSTD, ".zst", "\x28\xb5\x2f\xfd",     4, "zstd"}
+};
+
+/** Number of known compression formats **/
+static const size_t nformats = sizeof(formats)/sizeof(struct format);
+
+static void *decomp_worker(void *);
+static int32_t decomp_write(struct decomp *, const char *, size_t);
+#if HAVE_ZLIB_H && HAVE_LIBZ
+static int32_t decomp_gzip(struct decomp *, char *, char *);
+#endif
+#if HAVE_LZMA_H && HAVE_LIBLZMA
+static int32_t decomp_xz(struct decomp *, char *, char *);
+#endif
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+static int32_t decomp_zstd(struct decomp *, char *, char *);
+#endif
+
+/**
+ * Find the compression format of an open event log.
+ *
+ * The leading bytes of the file are checked, if there are too few of
+ * them the filename extension is used.
+ *
+ * @param[in]  filename  The event log filename.
+ * @param[in]  fd        The open event log.
+ * @return               The compression format, DECOMP_NONE if plain.
+ **/
+int32_t
+decomp_detect(const char *filename,
+	      int fd)
+{
+	size_t i     = 0;
+	size_t n     = 0;
+	ssize_t nr   = 0;
+	char magic[8] = {0};
+
+	nr = pread(fd, magic, sizeof(magic), 0);
+	for (i = 0; i < nformats; ++i) {
+		if (nr >= (ssize_t)formats[i].nmagic &&
+		    memcmp(magic, formats[i].magic, formats[i].nmagic) == 0) {
+			return(formats[i].fmt);
+		}
+	}
+	if (nr < 0 || (size_t)nr < sizeof(magic)) {
+		n = decomp_suffix(filename);
+		for (i = 0; n && i < nformats; ++i) {
+			if (strcmp(filename + strlen(filename) - n,
+				   formats[i].ext) == 0) {
+				return(formats[i].fmt);
+			}
+		}
+	}
+
+	return(DECOMP_NONE);
+}
+
+/**
+ * Length of a compression extension ending a filename.
+ *
+ * @param[in]  filename  The filename.
+ * @return               The length of the extension, 0 if there is none.
+ **/
+size_t
+decomp_suffix(const char *filename)
+{
+	size_t i = 0;
+	size_t n = strlen(filename);
+	size_t e = 0;
+
+	for (i = 0; i < nformats; ++i) {
+		e = strlen(formats[i].ext);
+		if (n >= e && strcmp(filename + n - e, formats[i].ext) == 0) {
+			return(e);
+		}
+	}
+	return(0);
+}
+
+/**
+ * Find a compressed event log if the plain one does not exist.
+ *
+ * Log rotation leaves the log under its own name plus a compression
+ * extension. If such a file is found the filename is replaced.
+ *
+ * @param[in,out] filename  The event log filename.
+ * @retval     0         If a file was found
+ * @retval     1         If there is no such file
+ **/
+int32_t
+decomp_find(char **filename)
+{
+	size_t i   = 0;
+	size_t n   = 0;
+	char *name = NULL;
+
+	if (access(*filename, F_OK) == 0) {
+		return(EXIT_SUCCESS);
+	}
+
+	n = strlen(*filename) + 8;
+	name = xmalloc(n * sizeof(char));
+	for (i = 0; i < nformats; ++i) {
+		snprintf(name, n, "%s%s", *filename, formats[i].ext);
+		if (access(name, F_OK) == 0) {
+			free(*filename);
+			*filename = name;
+			return(EXIT_SUCCESS);
+		}
+	}
+	free(name);
+
+	return(EXIT_FAILURE);
+}
+
+/**
+ * Start decompressing an event log into a stream.
+ *
+ * The event log descriptor is handed to the decompression thread,
+ * which closes it. The stream must be closed before decomp_close().
+ *
+ * @param[in]  filename  The event log filename.
+ * @param[in]  fd        The open event log.
+ * @param[in]  fmt       The compression format.
+ * @param[out] d         The decompression thread.
+ * @param[out] ifp       The decompressed stream.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error, fd is left open
+ **/
+int32_t
+decomp_open(const char *filename,
+	    int fd,
+	    int32_t fmt,
+	    struct decomp *d,
+	    FILE **ifp)
+{
+	int p[2] = {-1, -1};
+
+	*ifp = NULL;
+	memset(d, 0, sizeof(struct decomp));
+	d->in   = fd;
+	d->fmt  = fmt;
+	d->name = filename;
+
+	switch (fmt) {
+#if HAVE_ZLIB_H && HAVE_LIBZ
+		case DECOMP_GZIP:
+#endif
+#if HAVE_LZMA_H && HAVE_LIBLZMA
+		case DECOMP_XZ:
+#endif
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+		case DECOMP_ZSTD:
+#endif
+			break;
+		default:
+			warnx("%s: %s compression is not supported", filename,
+			      formats[fmt - 1].name);
+			return(EXIT_FAILURE);
+	}
+
+	if (pipe(p) == -1) {
+		warn("unable to create a pipe for %s", filename);
+		return(EXIT_FAILURE);
+	}
+#ifdef F_SETPIPE_SZ
+	fcntl(p[1], F_SETPIPE_SZ, DECOMP_PIPE);
+#endif
+	d->out = p[1];
+
+	if ((*ifp = fdopen(p[0], "r")) == NULL) {
+		warn("unable to read the pipe for %s", filename);
+		close(p[0]);
+		close(p[1]);
+		return(EXIT_FAILURE);
+	}
+	if (pthread_create(&d->tid, NULL, decomp_worker, d)) {
+		warnx("unable to create decompression thread for %s", filename);
+		fclose(*ifp);
+		*ifp = NULL;
+		close(p[1]);
+		return(EXIT_FAILURE);
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Wait for a decompression thread to finish.
+ *
+ * @param[in]  d         The decompression thread.
+ * @retval     0         If the event log was decompressed
+ * @retval     1         If there was an error
+ **/
+int32_t
+decomp_close(struct decomp *d)
+{
+	pthread_join(d->tid, NULL);
+	return(d->ierr);
+}
+
+/**
+ * Decompression thread.
+ *
+ * SIGPIPE is blocked so a parser that stops reading early leaves the
+ * thread with EPIPE rather than ending the program.
+ *
+ * @param[in]  vptr      The decompression state.
+ **/
+static void *
+decomp_worker(void *vptr)
+{
+	struct decomp *d = vptr;
+	char *ibuf       = NULL;
+	char *obuf       = NULL;
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	ibuf = xmalloc(DECOMP_BUFFER * sizeof(char));
+	obuf = xmalloc(DECOMP_BUFFER * sizeof(char));
+
+	switch (d->fmt) {
+#if HAVE_ZLIB_H && HAVE_LIBZ
+		case DECOMP_GZIP:
+			d->ierr = decomp_gzip(d, ibuf, obuf);
+			break;
+#endif
+#if HAVE_LZMA_H && HAVE_LIBLZMA
+		case DECOMP_XZ:
+			d->ierr = decomp_xz(d, ibuf, obuf);
+			break;
+#endif
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+		case DECOMP_ZSTD:
+			d->ierr = decomp_zstd(d, ibuf, obuf);
+			break;
+#endif
+		default:
+			d->ierr = EXIT_FAILURE;
+			break;
+	}
+
+	free(ibuf);
+	free(obuf);
+	close(d->in);
+	close(d->out);
+
+	return(NULL);
+}
+
+/**
+ * Write decompressed data to the pipe.
+ *
+ * @param[in]  d         The decompression state.
+ * @param[in]  buf       The data.
+ * @param[in]  n         The number of bytes.
+ * @retval     0         If it was sucessful
+ * @retval     1         If the pipe was closed or there was an error
+ **/
+static int32_t
+decomp_write(struct decomp *d,
+	     const char *buf,
+	     size_t n)
+{
+	ssize_t nw = 0;
+
+	while (n > 0) {
+		if ((nw = write(d->out, buf, n)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EPIPE) {
+				warn("unable to write decompressed %s", d->name);
+			}
+			return(EXIT_FAILURE);
+		}
+		buf += nw;
+		n   -= nw;
+	}
+	return(EXIT_SUCCESS);
+}
+
+#if HAVE_ZLIB_H && HAVE_LIBZ
+/**
+ * Decompress a gzip event log.
+ *
+ * Logs made of several concatenated gzip members are read in full.
+ *
+ * @param[in]  d         The decompression state.
+ * @param[in]  ibuf      A buffer of DECOMP_BUFFER bytes for input.
+ * @param[in]  obuf      A buffer of DECOMP_BUFFER bytes for output.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+decomp_gzip(struct decomp *d,
+	    char *ibuf,
+	    char *obuf)
+{
+	int32_t ierr = EXIT_SUCCESS;
+	int32_t done = 0;             /* The last stream has ended */
+	int zerr     = Z_OK;
+	ssize_t nr   = 0;
+	z_stream z;
+
+	memset(&z, 0, sizeof(z_stream));
+	/* 32 lets zlib detect the gzip header */
+	if (inflateInit2(&z, 15 + 32) != Z_OK) {
+		warnx("unable to initialise gzip for %s", d->name);
+		return(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		if ((nr = read(d->in, ibuf, DECOMP_BUFFER)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			warn("unable to read %s", d->name);
+			ierr = EXIT_FAILURE;
+			break;
+		}
+		z.next_in  = (Bytef *)ibuf;
+		z.avail_in = nr;
+		/* Drain the output, which may be pending with no input */
+		do {
+			z.next_out  = (Bytef *)obuf;
+			z.avail_out = DECOMP_BUFFER;
+			zerr = inflate(&z, Z_NO_FLUSH);
+			if (zerr != Z_OK && zerr != Z_STREAM_END &&
+			    zerr != Z_BUF_ERROR) {
+				warnx("corrupt gzip data in %s", d->name);
+				ierr = EXIT_FAILURE;
+				break;
+			}
+			if (decomp_write(d, obuf, DECOMP_BUFFER - z.avail_out)) {
+				ierr = EXIT_FAILURE;
+				break;
+			}
+			if (zerr == Z_STREAM_END) {
+				inflateReset(&z);
+				done = 1;
+			} else if (zerr == Z_OK) {
+				done = 0;
+			}
+		} while (z.avail_in > 0 || z.avail_out == 0);
+		if (nr == 0 || ierr) {
+			break;
+		}
+	}
+	if (ierr == EXIT_SUCCESS && !done) {
+		warnx("truncated gzip data in %s", d->name);
+		ierr = EXIT_FAILURE;
+	}
+
+	inflateEnd(&z);
+
+	return(ierr);
+}
+#endif
+
+#if HAVE_LZMA_H && HAVE_LIBLZMA
+/**
+ * Decompress a xz event log.
+ *
+ * @param[in]  d         The decompression state.
+ * @param[in]  ibuf      A buffer of DECOMP_BUFFER bytes for input.
+ * @param[in]  obuf      A buffer of DECOMP_BUFFER bytes for output.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+decomp_xz(struct decomp *d,
+	  char *ibuf,
+	  char *obuf)
+{
+	int32_t ierr      = EXIT_SUCCESS;
+	ssize_t nr        = 0;
+	lzma_ret lerr     = LZMA_OK;
+	lzma_action act   = LZMA_RUN;
+	lzma_stream z     = LZMA_STREAM_INIT;
+
+	if (lzma_stream_decoder(&z, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+		warnx("unable to initialise xz for %s", d->name);
+		return(EXIT_FAILURE);
+	}
+
+	z.next_out  = (uint8_t *)obuf;
+	z.avail_out = DECOMP_BUFFER;
+	while (lerr != LZMA_STREAM_END) {
+		if (z.avail_in == 0 && act == LZMA_RUN) {
+			if ((nr = read(d->in, ibuf, DECOMP_BUFFER)) == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				warn("unable to read %s", d->name);
+				ierr = EXIT_FAILURE;
+				break;
+			}
+			z.next_in  = (uint8_t *)ibuf;
+			z.avail_in = nr;
+			if (nr == 0) {
+				act = LZMA_FINISH;
+			}
+		}
+		lerr = lzma_code(&z, act);
+		if (z.avail_out == 0 || lerr == LZMA_STREAM_END) {
+			if (decomp_write(d, obuf, DECOMP_BUFFER - z.avail_out)) {
+				ierr = EXIT_FAILURE;
+				break;
+			}
+			z.next_out  = (uint8_t *)obuf;
+			z.avail_out = DECOMP_BUFFER;
+		}
+		if (lerr != LZMA_OK && lerr != LZMA_STREAM_END) {
+			warnx("corrupt xz data in %s", d->name);
+			ierr = EXIT_FAILURE;
+			break;
+		}
+	}
+
+	lzma_end(&z);
+
+	return(ierr);
+}
+#endif
+
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+/**
+ * Decompress a zstd event log.
+ *
+ * @param[in]  d         The decompression state.
+ * @param[in]  ibuf      A buffer of DECOMP_BUFFER bytes for input.
+ * @param[in]  obuf      A buffer of DECOMP_BUFFER bytes for output.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+decomp_zstd(struct decomp *d,
+	    char *ibuf,
+	    char *obuf)
+{
+	int32_t ierr   = EXIT_SUCCESS;
+	ssize_t nr     = 0;
+	size_t zerr    = 0;
+	size_t left    = 1;           /* Non-zero within a frame */
+	ZSTD_DStream *z = NULL;
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer out;
+
+	if ((z = ZSTD_createDStream()) == NULL) {
+		warnx("unable to initialise zstd for %s", d->name);
+		return(EXIT_FAILURE);
+	}
+	ZSTD_initDStream(z);
+
+	for (;;) {
+		if ((nr = read(d->in, ibuf, DECOMP_BUFFER)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			warn("unable to read %s", d->name);
+			ierr = EXIT_FAILURE;
+			break;
+		}
+		in.src  = ibuf;
+		in.size = nr;
+		in.pos  = 0;
+		/* Drain the output, which may be pending with no input */
+		do {
+			out.dst  = obuf;
+			out.size = DECOMP_BUFFER;
+			out.pos  = 0;
+			zerr = ZSTD_decompressStream(z, &out, &in);
+			if (ZSTD_isError(zerr)) {
+				warnx("corrupt zstd data in %s: %s", d->name,
+				      ZSTD_getErrorName(zerr));
+				ierr = EXIT_FAILURE;
+				break;
+			}
+			if (decomp_write(d, obuf, out.pos)) {
+				ierr = EXIT_FAILURE;
+				break;
+			}
+			if (in.size > 0 || out.pos > 0) {
+				left = zerr;
+			}
+		} while (in.pos < in.size || out.pos == out.size);
+		if (nr == 0 || ierr) {
+			break;
+		}
+	}
+	if (ierr == EXIT_SUCCESS && left != 0) {
+		warnx("truncated zstd data in %s", d->name);
+		ierr = EXIT_FAILURE;
+	}
+
+	ZSTD_freeDStream(z);
+
+	return(ierr);
+}
+#endif
+
+/**
+ * \}
+ **/
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file decomp.h
+ * Streaming decompression of archived event logs.
+ *
+ * \ingroup decomp
+ * \{
+ **/
+
+#ifndef DECOMP_H
+#define DECOMP_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Bytes decompressed at a time **/
+#define DECOMP_BUFFER   (1 << 18)
+
+/** Size asked for the pipe to the parser **/
+#define DECOMP_PIPE     (1 << 20)
+
+/** Compression formats of an event log **/
+enum decomp_fmt {
+	DECOMP_NONE = 0,
+	DECOMP_GZIP,
+	DECOMP_XZ,
+	DECOMP_ZSTD
+};
+
+/** A decompression thread feeding a pipe **/
+struct decomp {
+	pthread_t tid;                  /* Decompression thread */
+	int       in;                   /* Compressed input */
+	int       out;                  /* Write end of the pipe */
+	int32_t   fmt;                  /* Compression format */
+	int32_t   ierr;                 /* Set if decompression failed */
+	const char *name;               /* Filename, for messages */
+};
+
+/** Find the compression format of an open event log **/
+int32_t decomp_detect(const char *, int);
+
+/** Length of a compression extension ending a filename **/
+size_t decomp_suffix(const char *);
+
+/** Find a compressed event log if the plain one does not exist **/
+int32_t decomp_find(char **);
+
+/** Start decompressing an event log into a stream **/
+int32_t decomp_open(const char *, int, int32_t, struct decomp *, FILE **);
+
+/** Wait for a decompression thread to finish **/
+int32_t decomp_close(struct decomp *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* DECOMP_H */
+/**
+ * \}
+ **/
@@ -25,14 +25,109 @@
 #include <time.h>
 #include <unistd.h>
 #include <ctype.h>
-#include <regex.h>
 #include <string.h>
-#include <nmmintrin.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "config.h"
 #include "mem.h"
 #include "events.h"
 #include "projects.h"
+#include "scan.h"
+#include "decomp.h"
+#include "match.h"
+#include "cache.h"
+#include "events_hash.h"
+
+/** The names of the record types **/
+const char *const event_names[EVENT_TYPES] = {
+	EVENTS_TABLE(X_NAME)
+};
+
+/** Array of event function pointers, indexed by record type **/
+static const event_fp fps[EVENT_TYPES] = {
+	EVENTS_TABLE(X_ARRAY)
+};
+
+/** An event log file and the day it covers **/
+struct elog {
+	time_t day;
+	char   *name;
+};
+
+/** Fields of a RSVEND record, as spans of the line **/
+struct rsvend {
+	const char *name;               /* Reservation name */
+	size_t     nname;               /* Length of the name */
+	const char *epoch;              /* Epoch (NN of -NNz) */
+	const char *id;                 /* Instance id */
+	const char *start;              /* STARTTIME */
+	const char *end;                /* ENDTIME */
+	const char *nodes;              /* ALLOCTC */
+};
+
+/** Shared state for the threads parsing a range of event logs **/
+struct range {
+	pthread_mutex_t lock;           /* Protects progress, results, counts */
+	pthread_cond_t cond;            /* A file was taken, parsed, merged */
+	int32_t next;                   /* Next file to parse */
+	int32_t merged;                 /* Files merged into the projects */
+	int32_t window;                 /* Most files taken and not yet merged */
+	int32_t nfiles;                 /* Number of files */
+	int32_t *done;                  /* Set once each file is parsed */
+	int32_t *fails;                 /* Set for each file that failed */
+	struct counters counts;         /* What the workers have parsed */
+	const struct matcher *match;    /* Matcher of the project names */
+	const char *cache;              /* Cache directory, or NULL */
+	int32_t split;                  /* Threads to split each file between */
+	int32_t progress;               /* Print each file as it is parsed */
+	char **files;                   /* Event log filenames */
+	off_t *offsets;                 /* Bytes of each file to skip/read */
+	const struct project *projects; /* Projects to copy */
+	struct project **results;       /* Projects parsed from each file */
+	struct arena *arenas;           /* Copies of the projects */
+};
+
+/** The events of a merged log, handed to the writer **/
+struct batch {
+	struct parser ps;               /* Projects and sources to write */
+	struct arena arena;             /* Memory for the projects */
+	struct sources sources;         /* Logs ingested once written */
+};
+
+/** A thread writing the merged logs of a range, in order **/
+struct writer {
+	pthread_mutex_t lock;           /* Protects the queue */
+	pthread_cond_t cond;            /* A batch was queued or written */
+	struct batch *queue[EVENT_QUEUE]; /* Batches waiting, oldest first */
+	int32_t head;                   /* Oldest batch in the queue */
+	int32_t n;                      /* Batches queued or being written */
+	int32_t closed;                 /* No more batches will be queued */
+	int32_t ierr;                   /* Set once a flush has failed */
+	int32_t running;                /* The thread was started */
+	double secs;                    /* Seconds spent in flush */
+	int32_t (*flush)(struct parser *, void *); /* Writes a batch */
+	void *arg;                      /* Handed to flush */
+};
+
+/** A part of a mapped event log parsed by a thread of its own **/
+struct split {
+	pthread_t tid;
+	const char *buf;                /* Start of the part, a line start */
+	size_t n;                       /* Length of the part */
+	size_t used;                    /* Bytes of the part parsed */
+	struct layout layout;           /* Where the record type is */
+	const struct project *projects; /* Projects to copy */
+	struct project *result;         /* Projects parsed from the part */
+	struct arena arena;             /* Memory for the copy */
+	struct counters counts;         /* What the part held */
+	const struct matcher *match;    /* Matcher of the project names */
+	int32_t record;                 /* Keep the records for the cache */
+	struct cache_log log;           /* Records of the part */
+};
 
 /**
  * Generate the full filename for an event log file.
@@ -47,11 +142,27 @@ int32_t
 event_file(int32_t offset,
 	   const char *dir,
 	   char **filename)
+{
+	return(event_name(time(NULL) + (offset * SECS_IN_DAY), dir, filename));
+}
+
+/**
+ * Generate the full filename for the event log file of a day.
+ *
+ * @param[in]  day       A time within the day (UTC).
+ * @param[in]  dir       The MOAB stats directory.
+ * @param[out] filename  The absolute filename of the event log.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+event_name(time_t day,
+	   const char *dir,
+	   char **filename)
 {
 	long fmax    = 0;
 	long pmax    = 0;
-	time_t now   = 0;
-	struct tm *t = NULL;
+	struct tm t  = {0};
 	char *tstr   = NULL;
 
 	if ((fmax = pathconf(dir, _PC_NAME_MAX)) == -1) {
@@ -63,10 +174,9 @@ event_file(int32_t offset,
 		return(EXIT_FAILURE);
 	}
 
-	now = time(NULL) + (offset * SECS_IN_DAY);
-	t = gmtime(&now);
+	gmtime_r(&day, &t);
 	tstr = xmalloc(fmax * sizeof(char));
-	strftime(tstr, fmax, "events.%a_%b_%d_%Y", t);
+	strftime(tstr, fmax, EVENT_FORMAT, &t);
 
 	*filename = xmalloc((pmax + fmax) * sizeof(char));
 
@@ -80,298 +190,1700 @@ event_file(int32_t offset,
 	return(EXIT_SUCCESS);
 }
 
+/**
+ * Compare two event log files by their day, then by name.
+ *
+ * A plain log sorts before its compressed copy.
+ **/
+static int
+event_cmp(const void *a,
+	  const void *b)
+{
+	const struct elog *x = a;
+	const struct elog *y = b;
+
+	if (x->day != y->day) {
+		return((x->day > y->day) - (x->day < y->day));
+	}
+	return(strcmp(x->name, y->name));
+}
+
+/**
+ * Find all the event log files within a range of days.
+ *
+ * The stats directory is searched for files named after the
+ * EVENT_FORMAT, possibly compressed, any whose day falls within
+ * [from, to] are returned
+ * oldest first. The returned array and names should be free()'ed.
+ *
+ * @param[in]  dir       The MOAB stats directory.
+ * @param[in]  from      The first day (UTC).
+ * @param[in]  to        The last day (UTC).
+ * @param[out] files     The absolute filenames of the event logs.
+ * @param[out] n         The number of event logs found.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
 int32_t
-event_search(const char *stats_dir,
-	     int32_t offset,
-	     void *vptr)
+event_files(const char *dir,
+	    time_t from,
+	    time_t to,
+	    char ***files,
+	    int32_t *n)
 {
-	int32_t ierr   = 0;           /* Error number */
-	int32_t eoff   = 0;           /* Offset to the event type */
-	size_t i       = 0;           /* Loop indexer */
-	size_t lmax    = PAGE_SIZE*4; /* The event log has long lines */
-	ssize_t nlen   = 0;           /* Length of the line read */
-	size_t nfps    = 0;           /* Size of the fps array */
-	int64_t ln     = 0;           /* Current line number */
-	FILE *ifp      = NULL;        /* Input file pointer */
-	char *filename = NULL;        /* Event log filename */
-	char *line     = NULL;        /* Line read from the file */
-	const event_fp fps[] = {      /* Array of event function pointers */
-		EVENTS_TABLE(X_ARRAY)
-	};
+	int32_t i          = 0;
+	int32_t j          = 0;
+	int32_t nmax       = 0;
+	size_t len         = 0;
+	char *ptr          = NULL;
+	DIR *dp            = NULL;
+	struct dirent *de  = NULL;
+	struct elog *logs  = NULL;
+	struct elog *tmp   = NULL;
+	struct tm t        = {0};
+	time_t day         = 0;
 
-	line = xmemalign(lmax * sizeof(char));
-	nfps = sizeof(fps)/sizeof(event_fp);
+	*files = NULL;
+	*n = 0;
 
-	if ((ierr = event_file(offset, stats_dir, &filename)) !=0) {
-		goto rtn_err;
+	/* Only compare whole days */
+	from -= from % SECS_IN_DAY;
+	to   -= to % SECS_IN_DAY;
+
+	if ((dp = opendir(dir)) == NULL) {
+		warn("unable to open stats directory %s", dir);
+		return(EXIT_FAILURE);
 	}
 
-	printf("Event log: %s\n", filename);
-	if ((ifp = fopen(filename, "r")) == NULL) {
-		warn("unable to open event log %s", filename);
-		ierr = EXIT_FAILURE;
-		goto rtn_err;
+	while ((de = readdir(dp)) != NULL) {
+		memset(&t, 0, sizeof(struct tm));
+		ptr = strptime(de->d_name, EVENT_FORMAT, &t);
+		if (ptr == NULL || strlen(ptr) != decomp_suffix(ptr)) {
+			continue;
+		}
+		day = timegm(&t);
+		if (day < from || day > to) {
+			continue;
+		}
+		if (*n == nmax) {
+			nmax = nmax ? nmax * 2 : 32;
+			tmp = realloc(logs, nmax * sizeof(struct elog));
+			if (tmp == NULL) {
+				warn("unable to list %s", dir);
+				closedir(dp);
+				for (i = 0; i < *n; ++i) {
+					free(logs[i].name);
+				}
+				free(logs);
+				*n = 0;
+				return(EXIT_FAILURE);
+			}
+			logs = tmp;
+		}
+		len = strlen(dir) + strlen(de->d_name) + 2;
+		logs[*n].day  = day;
+		logs[*n].name = xmalloc(len * sizeof(char));
+		snprintf(logs[*n].name, len, "%s/%s", dir, de->d_name);
+		*n += 1;
 	}
+	closedir(dp);
 
-	/* get the first line to figure out the offset to the event type */
-	if (fgets(line, lmax, ifp) == NULL) {
-		warn("unable to obtain an entry from %s", filename);
-		ierr = EXIT_FAILURE;
-		goto rtn_err;
+	if (*n == 0) {
+		warnx("no event logs found in %s", dir);
+		free(logs);
+		return(EXIT_FAILURE);
 	}
-	for (i=0; i < lmax; ++i) {
-		if (isalpha(line[i])) {
-			eoff = i;
-			break;
+
+	/* A log caught mid rotation is only read once */
+	qsort(logs, *n, sizeof(struct elog), event_cmp);
+	*files = xmalloc(*n * sizeof(char *));
+	for (i = 0, j = 0; i < *n; ++i) {
+		if (j > 0 && logs[i].day == logs[i - 1].day) {
+			free(logs[i].name);
+			continue;
 		}
+		(*files)[j++] = logs[i].name;
+	}
+	*n = j;
+	free(logs);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Make room for at least n events in a set of columns.
+ *
+ * @param[in,out] c      The columns.
+ * @param[in]  n         The number of events needed.
+ **/
+void
+columns_reserve(struct columns *c,
+		int64_t n)
+{
+	int64_t cap = c->cap ? c->cap : 64;
+
+	if (n <= c->cap) {
+		return;
+	}
+	while (cap < n) {
+		cap *= 2;
 	}
+	c->epochs = xrealloc(c->epochs, cap * sizeof(uint8_t));
+	c->ids    = xrealloc(c->ids,    cap * sizeof(int64_t));
+	c->nodes  = xrealloc(c->nodes,  cap * sizeof(int64_t));
+	c->starts = xrealloc(c->starts, cap * sizeof(int64_t));
+	c->ends   = xrealloc(c->ends,   cap * sizeof(int64_t));
+	c->cap    = cap;
+}
+
+/**
+ * Append an event to a set of columns.
+ *
+ * @param[in,out] c      The columns.
+ * @param[in]  e         The event.
+ * @return               The row of the event.
+ **/
+int64_t
+columns_append(struct columns *c,
+	       const struct event *e)
+{
+	int64_t i = c->n;
+
+	columns_reserve(c, i + 1);
+	c->epochs[i] = e->epoch;
+	c->ids[i]    = e->id;
+	c->nodes[i]  = e->nodes;
+	c->starts[i] = e->start;
+	c->ends[i]   = e->end;
+	c->n += 1;
+
+	return(i);
+}
+
+/**
+ * Append all of the events in one set of columns to another.
+ *
+ * @param[in,out] dst    The columns to append to.
+ * @param[in]  src       The columns to append.
+ **/
+void
+columns_concat(struct columns *dst,
+	       const struct columns *src)
+{
+	int64_t n = dst->n;
 
-	if (line[eoff] < nfps && fps[line[eoff]] != 0) {
-		fps[line[eoff]](line, vptr);
+	if (src->n == 0) {
+		return;
 	}
+	columns_reserve(dst, n + src->n);
+	memcpy(dst->epochs + n, src->epochs, src->n * sizeof(uint8_t));
+	memcpy(dst->ids    + n, src->ids,    src->n * sizeof(int64_t));
+	memcpy(dst->nodes  + n, src->nodes,  src->n * sizeof(int64_t));
+	memcpy(dst->starts + n, src->starts, src->n * sizeof(int64_t));
+	memcpy(dst->ends   + n, src->ends,   src->n * sizeof(int64_t));
+	dst->n += src->n;
+}
 
-	while ((nlen = getline(&line, &lmax, ifp)) != -1) {
-		++ln;
-		/*
-		if ((ln % 10000) == 0) {
-			printf("Processed: %d\n", ln);
+/**
+ * Read an event from a set of columns.
+ *
+ * @param[in]  c         The columns.
+ * @param[in]  i         The row of the event.
+ * @param[out] e         The event.
+ **/
+void
+columns_get(const struct columns *c,
+	    int64_t i,
+	    struct event *e)
+{
+	e->epoch = c->epochs[i];
+	e->id    = c->ids[i];
+	e->nodes = c->nodes[i];
+	e->start = c->starts[i];
+	e->end   = c->ends[i];
+}
+
+/**
+ * Free a set of columns.
+ *
+ * @param[in,out] c      The columns.
+ **/
+void
+columns_free(struct columns *c)
+{
+	free(c->epochs);
+	free(c->ids);
+	free(c->nodes);
+	free(c->starts);
+	free(c->ends);
+	memset(c, 0, sizeof(struct columns));
+}
+
+/**
+ * Find the base name of an event log.
+ *
+ * A compression extension is not part of the name, so a log that has
+ * been rotated and compressed is still known.
+ *
+ * @param[in]  filename  The event log file.
+ * @param[out] name      The name following the last '/'.
+ * @return               The length of the name.
+ **/
+static size_t
+sources_base(const char *filename,
+	     const char **name)
+{
+	const char *ptr = strrchr(filename, '/');
+
+	*name = ptr ? ptr + 1 : filename;
+	return(strlen(*name) - decomp_suffix(*name));
+}
+
+/**
+ * Find how much of an event log has been ingested.
+ *
+ * @param[in]  s         The ingested event logs, may be NULL.
+ * @param[in]  filename  The event log file.
+ * @return               The number of bytes ingested, 0 if none.
+ **/
+int64_t
+sources_find(const struct sources *s,
+	     const char *filename)
+{
+	int32_t i = 0;
+	size_t n  = 0;
+	const char *name = NULL;
+
+	if (s == NULL) {
+		return(0);
+	}
+	n = sources_base(filename, &name);
+	for (i = 0; i < s->n; ++i) {
+		if (strncmp(s->s[i].name, name, n) == 0 &&
+		    s->s[i].name[n] == '\0') {
+			return(s->s[i].size);
 		}
-		*/
-		if (line[eoff] < nfps && fps[line[eoff]] != 0) {
-			fps[line[eoff]](line, vptr);
+	}
+	return(0);
+}
+
+/**
+ * Record how much of an event log has been ingested.
+ *
+ * @param[in,out] s      The ingested event logs, may be NULL.
+ * @param[in]  filename  The event log file.
+ * @param[in]  size      The number of bytes ingested.
+ **/
+void
+sources_set(struct sources *s,
+	    const char *filename,
+	    int64_t size)
+{
+	int32_t i = 0;
+	size_t n  = 0;
+	const char *name = NULL;
+
+	if (s == NULL) {
+		return;
+	}
+	n = sources_base(filename, &name);
+	if (n >= SOURCE_NAME_MAX) {
+		warnx("event log name %s is too long to record", name);
+		return;
+	}
+	for (i = 0; i < s->n; ++i) {
+		if (strncmp(s->s[i].name, name, n) == 0 &&
+		    s->s[i].name[n] == '\0') {
+			s->s[i].size = size;
+			return;
 		}
 	}
+	if (s->n == s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 32;
+		s->s = xrealloc(s->s, s->cap * sizeof(struct source));
+	}
+	memset(&s->s[s->n], 0, sizeof(struct source));
+	memcpy(s->s[s->n].name, name, n);
+	s->s[s->n].size = size;
+	s->n += 1;
+}
+
+/**
+ * Free a list of ingested event logs.
+ *
+ * @param[in,out] s      The ingested event logs.
+ **/
+void
+sources_free(struct sources *s)
+{
+	free(s->s);
+	memset(s, 0, sizeof(struct sources));
+}
 
-	/*
-	printf("# lines: %d\n", ln);
-	*/
+/**
+ * Add one set of parser counters to another.
+ *
+ * @param[in,out] dst    The counters to add to.
+ * @param[in]  src       The counters to add.
+ **/
+void
+counters_add(struct counters *dst,
+	     const struct counters *src)
+{
+	int32_t i = 0;
 
-rtn_err:
-	if (line) {
-		free(line);
-		line = NULL;
+	dst->lines     += src->lines;
+	dst->bytes     += src->bytes;
+	dst->jobs      += src->jobs;
+	dst->rsvs      += src->rsvs;
+	dst->unmatched += src->unmatched;
+	dst->malformed += src->malformed;
+	dst->other     += src->other;
+	for (i = 0; i < EVENT_TYPES; ++i) {
+		dst->types[i] += src->types[i];
 	}
+}
 
-	if (ifp) {
-		fclose(ifp);
-		ifp = NULL;
+/**
+ * Look up the record type of the field starting at a column.
+ *
+ * The field must start a field, that is follow a space, and be a
+ * whole record type. One hash and one compare decide it.
+ *
+ * @param[in]  line      The line.
+ * @param[in]  n         The length of the line.
+ * @param[in]  off       The column of the field.
+ * @return               The record type, or -1 if there is none.
+ **/
+static int32_t
+event_type(const char *restrict line,
+	   size_t n,
+	   size_t off)
+{
+	int32_t t       = 0;
+	size_t len      = 0;
+	const char *f   = line + off;
+	const char *end = NULL;
+
+	if (off == 0 || off >= n || line[off - 1] != ' ' || *f == ' ') {
+		return(-1);
 	}
+	if ((end = memchr(f, ' ', n - off)) == NULL) {
+		end = line + n;
+	}
+	len = end - f;
 
-	return(ierr);
+	t = event_slots[event_hash(f, len, EVENT_HASH_SEED) &
+			(EVENT_HASH_SIZE - 1)];
+	if (t < 0 || strncmp(event_names[t], f, len) != 0 ||
+	    event_names[t][len] != '\0') {
+		return(-1);
+	}
+	return(t);
 }
 
-int32_t
-event_rsv(const char *restrict line,
-	  void *vptr
-	  )
+/**
+ * Find the column a field starts at.
+ *
+ * Fields are separated by runs of spaces.
+ *
+ * @param[in]  line      The line.
+ * @param[in]  n         The length of the line.
+ * @param[in]  field     The field, counting from 0.
+ * @return               The column of the field, or -1 if there is none.
+ **/
+static int32_t
+event_field(const char *restrict line,
+	    size_t n,
+	    int32_t field)
 {
-	static const char r[] = "RSVEND.*"
-				"NAME=([A-za-z0-9-]+)-([0-9]{2})z\.([0-9]+).*"
-				"STARTTIME=([0-9]+).*"
-				"ENDTIME=([0-9]+).*"
-				"ALLOCTC=([0-9]+).*";
-#if 0
-				"RSVGROUP=([A-za-z0-9-]+)-([0-9]{2})z";
-#endif
-	uint8_t update        = 0;
-	int32_t ierr          = 0;
-	int32_t nlen          = 0;
-	char rstr[PAGE_SIZE];
-	static regex_t rq     = {0};
-	regmatch_t m[7]       = {0};
-	struct event *res     = NULL;
-	struct event *tmp     = NULL;
-	struct project *p     = NULL;
-	struct project **projects = (struct project **)vptr;
+	size_t i = 0;
 
-	/* Create a regex for reservation jobs */
-	if ((ierr = regcomp(&rq, r, REG_EXTENDED|REG_NEWLINE)) != 0) {
-		regerror(ierr, &rq, rstr, PAGE_SIZE);
-		warnx("unable to compile regex '%s': %s", r, rstr);
-		return(EXIT_FAILURE);
+	while (i < n && line[i] == ' ') {
+		++i;
 	}
-	if (regexec(&rq, line, 7, m, 0) == 0) {
-#if 0
-		printf("start: %.*s\tend: %.*s\trsv: %.*s\tnodes: %.*s\n",
-		       m[1].rm_eo - m[1].rm_so, line + m[1].rm_so,
-		       m[2].rm_eo - m[2].rm_so, line + m[2].rm_so,
-		       m[4].rm_eo - m[4].rm_so, line + m[4].rm_so,
-		       m[3].rm_eo - m[3].rm_so, line + m[3].rm_so
-		       );
-#endif
-		res = xmalloc(sizeof(struct event));
-		nlen = m[1].rm_eo - m[1].rm_so;
-		res->name  = xmalloc((nlen +1)*sizeof(char));
-		strncpy(res->name, line + m[1].rm_so, nlen);
-		res->epoch = strtoul(line + m[2].rm_so, NULL, 10);
-		res->id    = strtol(line + m[3].rm_so, NULL, 10);
-		res->start = strtol(line + m[4].rm_so, NULL, 10);
-		res->end   = strtol(line + m[5].rm_so, NULL, 10);
-		res->nodes = strtol(line + m[6].rm_so, NULL, 10);
-		/* Search for the reservation within the projects */
-		p = *projects;
-		while (p != NULL) {
-			if (strncmp(res->name, p->name, nlen) == 0) {
-				/* MOAB creates a reservation even if all
-				 * nodes are not avaliable. It will then
-				 * recreate the reservation when more nodes
-				 * are added. So we must check to see if
-				 * this is an "update" to a reservation.
-				 */
-				tmp = p->reservations;
-				while (tmp != NULL) {
-					if (tmp->end == res->end) {
-						update = 1;
-						break;
-					}
-					tmp = tmp->next;
-				}
-				if (update) {
-					tmp->start = res->start;
-					tmp->nodes = res->nodes;
-					free(res->name);
-					free(res);
-				} else {
-					res->next = p->reservations;
-					p->reservations = res;
-					p->nr += 1;
-				}
-				break;
-			}
-			p = p->next;
+	for (; field > 0; --field) {
+		while (i < n && line[i] != ' ') {
+			++i;
+		}
+		while (i < n && line[i] == ' ') {
+			++i;
 		}
 	}
-
-	/*
-	 regfree(&rq);
-	 */
-
-	return(EXIT_SUCCESS);
+	return(i < n ? (int32_t)i : -1);
 }
 
-int32_t
-event_job(const char *restrict line,
-	  void *vptr
-	  )
+/**
+ * Find which field of a line holds the record type.
+ *
+ * The record type is the first field that is a known record type,
+ * which for MOAB is the fifth, after the time, the epoch and record
+ * number, the object type and the object id.
+ *
+ * @param[in]  line      The line.
+ * @param[in]  n         The length of the line.
+ * @param[out] l         The layout found.
+ * @retval     0         If a record type was found
+ * @retval     1         If the line holds none
+ **/
+static int32_t
+event_layout(const char *restrict line,
+	     size_t n,
+	     struct layout *l)
 {
-	int32_t ierr          = 0;
-	int32_t nlen          = 0;
-	int32_t nodes         = 0;
-	static uint32_t joff  = 0;
-	char *ptr             = NULL;
-	char *sptr            = NULL;
-	struct event *job     = NULL;
-	struct project *p     = NULL;
-	struct project **projects = (struct project **)vptr;
-	const char space = ' ';
-	const char *jterms[] = {     /* Array of job terms */
-		"JOBEND",
-		"REQUESTEDNC=",
-		"REQRSV=",
-		"STARTTIME=",
-		"COMPLETETIME=",
-		"DRMJID="
-	};
-	const int jsizes[] = {       /* Size of job terms */
-		6, 12, 7, 10, 13, 7
-	};
-
-	/* First time looking for JOBEND */
-	if (joff == 0) {
-		ptr = strstr(line, jterms[0]);
-		if (ptr == NULL) {
+	int32_t i   = 0;
+	int32_t off = 0;
+
+	for (i = 1; (off = event_field(line, n, i)) >= 0; ++i) {
+		if (event_type(line, n, off) >= 0) {
+			l->field = i;
+			l->off   = off;
 			return(EXIT_SUCCESS);
 		}
-		joff = ptr - line;
 	}
+	return(EXIT_FAILURE);
+}
 
-	/* All other times look for JOBEND */
-	if (strncmp(line + joff, jterms[0], jsizes[0]) != 0) {
-		return(EXIT_SUCCESS);
+/**
+ * Dispatch a single line to the function for its record type.
+ *
+ * The record type is looked for where it was on the previous line,
+ * and only when it is not there are the fields counted again. This
+ * copes with columns that move, such as a record number that gains a
+ * digit part way through a log.
+ *
+ * @param[in]  line      The line, terminated at line[n].
+ * @param[in]  n         The length of the line (without the newline).
+ * @param[in,out] l      The layout of the event log.
+ * @param[in]  vptr      The projects passed to the event functions.
+ **/
+static void
+event_dispatch(const char *restrict line,
+	       size_t n,
+	       struct layout *l,
+	       void *vptr)
+{
+	int32_t t         = 0;
+	int32_t off       = 0;
+	struct parser *ps = (struct parser *)vptr;
+
+	ps->counts.lines += 1;
+	if (l->field < 0 && event_layout(line, n, l)) {
+		ps->counts.other += 1;
+		return;
+	}
+	if ((t = event_type(line, n, l->off)) < 0) {
+		if ((off = event_field(line, n, l->field)) < 0 ||
+		    (t = event_type(line, n, off)) < 0) {
+			ps->counts.other += 1;
+			return;
+		}
+		l->off = off;
 	}
+	ps->counts.types[t] += 1;
+	fps[t](line, n, vptr);
+}
 
-	/* Look for REQSRV */
-	ptr = strstr(line, jterms[2]);
-	if (ptr == NULL) {
-		return(EXIT_SUCCESS);
+/**
+ * Parse the complete lines within a buffer.
+ *
+ * Lines are handed to the event functions in place, each terminated by
+ * its newline. Anything after the last newline is left unparsed.
+ *
+ * @param[in]  buf       The buffer of lines.
+ * @param[in]  size      The size of the buffer in bytes.
+ * @param[in,out] l      The layout of the event log, found from the
+ *                       first line if not yet known.
+ * @param[in]  vptr      The projects passed to the event functions.
+ * @return               The number of bytes parsed.
+ **/
+size_t
+event_lines(const char *buf,
+	    size_t size,
+	    struct layout *l,
+	    void *vptr)
+{
+	size_t n        = 0;          /* Length of the line */
+	const char *ptr = buf;        /* Start of the current line */
+	const char *nl  = NULL;       /* End of the current line */
+	const char *end = buf + size; /* End of the buffer */
+
+	while (ptr < end) {
+		if ((nl = memchr(ptr, '\n', end - ptr)) == NULL) {
+			break;
+		}
+		n = nl - ptr;
+		event_dispatch(ptr, n, l, vptr);
+		ptr = nl + 1;
 	}
+	((struct parser *)vptr)->counts.bytes += ptr - buf;
+
+	return(ptr - buf);
+}
 
-	/* Look for the end of the REQSRV=XXXX string */
-	ptr += jsizes[2];
-	sptr = strchr(ptr, space);
+/**
+ * Worker thread for parsing part of a mapped event log.
+ *
+ * @param[in]  vptr      The part to parse.
+ **/
+static void *
+event_split_worker(void *vptr)
+{
+	struct split *sp  = vptr;
+	struct parser ps  = {0};
+	struct pindex idx = {0};
 
-	/* Create a job event */
-	job = xmalloc(sizeof(struct event));
+	arena_init(&sp->arena, PAGE_SIZE);
+	project_clone(sp->projects, &ps.projects, &sp->arena);
+	project_index(ps.projects, &idx);
+	ps.index = &idx;
+	ps.match = sp->match;
+	ps.arena = &sp->arena;
+	ps.log   = sp->record ? &sp->log : NULL;
+	sp->used = event_lines(sp->buf, sp->n, &sp->layout, &ps);
+	sp->result = ps.projects;
+	sp->counts = ps.counts;
+	project_index_free(&idx);
 
-	/* If the job ends with \d\dz, remove them */
-	if (*(sptr -1) == 'z'   &&
-	    isdigit(*(sptr -2)) &&
-	    isdigit(*(sptr -3))) {
-		sptr -= 4;  /* remove the leading - too */
-		job->epoch = strtoul(sptr+1, NULL, 10);
-	}
+	return(NULL);
+}
 
-	nlen = sptr - ptr;
-	job->name  = xmalloc((nlen +1)*sizeof(char));
-	strncpy(job->name, ptr, nlen);
+/**
+ * Parse the complete lines within a buffer on several threads.
+ *
+ * The buffer is cut into parts at line boundaries and each part is
+ * parsed into a copy of the projects. The copies are then merged back
+ * in order, so reservation updates are applied as if the lines were
+ * read in turn. Parts smaller than EVENT_SPLIT_MIN are not worth a
+ * thread, so a small buffer is parsed as it is.
+ *
+ * @param[in]  buf       The buffer of lines.
+ * @param[in]  size      The size of the buffer in bytes.
+ * @param[in,out] l      The layout of the event log.
+ * @param[in]  ps        The parser state holding the projects.
+ * @return               The number of bytes parsed.
+ **/
+static size_t
+event_split(const char *buf,
+	    size_t size,
+	    struct layout *l,
+	    struct parser *ps)
+{
+	int32_t i        = 0;
+	int32_t n        = ps->nthreads;
+	int32_t started  = 0;             /* Parts given a thread */
+	size_t used      = 0;
+	const char *ptr  = buf;
+	const char *end  = buf + size;
+	const char *nl   = NULL;
+	struct split *sp = NULL;
 
-	/* Search for the job within the projects */
-	p = *projects;
-	while (p != NULL) {
-		if (strcmp(job->name, p->name) == 0) {
-			/* Look for the node count */
-			job->nodes = 1;
-			ptr = strstr(line, jterms[1]);
-			if (ptr) {
-				ptr += jsizes[1];
-				job->nodes = strtol(ptr, NULL, 10);
-			}
+	if ((size_t)n > size / EVENT_SPLIT_MIN) {
+		n = size / EVENT_SPLIT_MIN;
+	}
+	if (n < 2) {
+		return(event_lines(buf, size, l, ps));
+	}
 
-			/* Look for the STARTTIME */
-			sptr = strstr(line, jterms[3]);
-			if (!sptr) {
-				break;
-			}
-			sptr += jsizes[3];
-			job->start = strtol(sptr, NULL, 10);
-			ptr = sptr;
-
-			/* Look for the COMPLETETIME */
-			sptr = strstr(ptr, jterms[4]);
-			sptr += jsizes[4];
-			job->end = strtol(sptr, NULL, 10);
-			ptr = sptr;
-
-			/* Look for the TASKMAP */
-			/* The problem is this list reports
-			 * a node name per task/core.
-			sptr = strstr(ptr, jterms[5]);
-			sptr += jsizes[5];
-			while (*sptr != space) {
-				if (*sptr == ',') {
-					++nodes;
-				}
-				++sptr;
-			}
-			ptr = sptr;
-			job->nodes = nodes +1;
-			*/
+	/* Every part starts from the layout of the first line */
+	if (l->field < 0 && (nl = memchr(buf, '\n', size)) != NULL) {
+		event_layout(buf, nl - buf, l);
+	}
 
-			/* Look for the job id */
-			sptr = strstr(ptr, jterms[5]);
-			sptr += jsizes[5];
-			job->id = strtol(sptr, NULL, 10);
-			ptr = sptr;
+	sp = xmalloc(n * sizeof(struct split));
+	memset(sp, 0, n * sizeof(struct split));
+	for (i = 0; i < n; ++i) {
+		sp[i].buf      = ptr;
+		sp[i].layout   = *l;
+		sp[i].projects = ps->projects;
+		sp[i].match    = ps->match;
+		sp[i].record   = (ps->log != NULL);
+		nl = (i == n - 1) ? end : buf + (size / n) * (i + 1);
+		if (nl < ptr) {
+			nl = ptr;
+		}
+		/* Move the cut to just after a newline */
+		if (nl < end && (nl = memchr(nl, '\n', end - nl)) != NULL) {
+			nl += 1;
+		} else {
+			nl = end;
+		}
+		sp[i].n = nl - ptr;
+		ptr = nl;
+		/* Parts left without a thread are parsed here instead */
+		if (started == i && pthread_create(&sp[i].tid, NULL,
+						   event_split_worker,
+						   &sp[i]) == 0) {
+			started = i + 1;
+		} else if (started == i) {
+			warnx("unable to create worker thread");
+		}
+	}
+	for (i = started; i < n; ++i) {
+		event_split_worker(&sp[i]);
+	}
 
-			p->nj += 1;
-			job->next = p->jobs;
-			p->jobs = job;
+	/* Merge the parts in order */
+	for (i = 0; i < n; ++i) {
+		if (i < started) {
+			pthread_join(sp[i].tid, NULL);
 		}
-		p = p->next;
+		project_merge(ps->projects, sp[i].result);
+		project_free(sp[i].result);
+		arena_free(&sp[i].arena);
+		counters_add(&ps->counts, &sp[i].counts);
+		if (ps->log) {
+			cache_concat(ps->log, &sp[i].log);
+		}
+		cache_free(&sp[i].log);
+	}
+
+	/* Only the last part can end without a newline */
+	used = (sp[n - 1].buf - buf) + sp[n - 1].used;
+	free(sp);
+
+	return(used);
+}
+
+/**
+ * Parse an event log that has been mapped into memory.
+ *
+ * Lines are handed to the event functions straight from the mapping,
+ * each terminated by its newline. A final line without a newline may
+ * still be being written, so it is left for the next run to read.
+ *
+ * @param[in]  fd        The open event log.
+ * @param[in]  size      The size of the event log in bytes.
+ * @param[in,out] offset The byte to start parsing from, then the byte
+ *                       after the last newline parsed.
+ * @param[in]  vptr      The projects passed to the event functions.
+ * @retval     0         If it was sucessful
+ * @retval     1         If the file could not be mapped
+ **/
+static int32_t
+event_map(int fd,
+	  size_t size,
+	  off_t *offset,
+	  void *vptr)
+{
+	struct layout l = LAYOUT_INIT; /* Where the record type is */
+	char *map       = NULL;       /* Mapped event log */
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		return(EXIT_FAILURE);
 	}
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	*offset += event_split(map + *offset, size - *offset, &l,
+			       (struct parser *)vptr);
+	munmap(map, size);
+
 	return(EXIT_SUCCESS);
 }
 
+/**
+ * Parse an event log through a buffered stream.
+ *
+ * This is used for event logs that can not be mapped (pipes, empty
+ * or special files) and for decompressed event logs. A stream that
+ * can not seek has the lines already ingested skipped over. A final
+ * line without a newline is only parsed if the log is complete, as
+ * otherwise it may still be being written.
+ *
+ * @param[in]  ifp       The open event log.
+ * @param[in]  skip      The number of bytes to skip.
+ * @param[in]  partial   Parse a final line without a newline.
+ * @param[in,out] size   The number of bytes read.
+ * @param[in]  vptr      The projects passed to the event functions.
+ * @retval     0         If it was sucessful
+ **/
+static int32_t
+event_read(FILE *ifp,
+	   off_t skip,
+	   int32_t partial,
+	   off_t *size,
+	   void *vptr)
+{
+	struct layout l = LAYOUT_INIT; /* Where the record type is */
+	size_t lmax    = PAGE_SIZE*4; /* The event log has long lines */
+	ssize_t nlen   = 0;           /* Length of the line read */
+	char *line     = NULL;        /* Line read from the file */
+	struct parser *ps = (struct parser *)vptr;
+
+	line = xmalloc(lmax * sizeof(char));
+
+	while ((nlen = getline(&line, &lmax, ifp)) != -1) {
+		if (!partial && nlen > 0 && line[nlen - 1] != '\n') {
+			break;
+		}
+		*size += nlen;
+		if (*size <= skip) {
+			continue;
+		}
+		ps->counts.bytes += nlen;
+		if (nlen > 0 && line[nlen - 1] == '\n') {
+			line[--nlen] = '\0';
+		}
+		event_dispatch(line, nlen, &l, vptr);
+	}
+
+	if (line) {
+		free(line);
+		line = NULL;
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Parse an event log file for reservation records.
+ *
+ * Regular files are mapped into memory and parsed in place, compressed
+ * files are decompressed on a thread of their own and anything else
+ * falls back to a buffered read.
+ *
+ * Parsing starts at the given offset, so a log that has grown since
+ * it was last ingested only has its new records read. The offset is
+ * updated to the number of bytes that have now been ingested, which
+ * for a plain log ends at its last newline, so a record still being
+ * written is read whole by the next run. For a compressed log the
+ * offsets count the decompressed bytes.
+ *
+ * With a cache directory, a log read from the start is replayed from
+ * its cache if it has one, otherwise its records are cached as it is
+ * parsed.
+ *
+ * @param[in]  filename  The event log file.
+ * @param[in,out] offset The byte to start from, then the bytes read.
+ * @param[in]  vptr      The parser state passed to the event functions.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+event_parse(const char *filename,
+	    off_t *offset,
+	    void *vptr)
+{
+	int32_t ierr   = 0;           /* Error number */
+	int32_t fmt    = DECOMP_NONE; /* Compression format */
+	int fd         = -1;          /* Input file descriptor */
+	off_t skip     = 0;           /* Bytes to skip in a stream */
+	FILE *ifp      = NULL;        /* Input file pointer */
+	struct stat sb = {0};         /* Event log status */
+	struct decomp d;              /* Decompression thread */
+	struct cache_log log = {0};   /* Records to cache */
+	struct counters before;       /* Counters before the log */
+	struct parser *ps = (struct parser *)vptr;
+
+	if ((fd = open(filename, O_RDONLY)) == -1) {
+		warn("unable to open event log %s", filename);
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+	if (fstat(fd, &sb) == -1) {
+		warn("unable to stat event log %s", filename);
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+
+	if (S_ISREG(sb.st_mode)) {
+		fmt = decomp_detect(filename, fd);
+	}
+
+	if (fmt == DECOMP_NONE && S_ISREG(sb.st_mode) && *offset > 0 &&
+	    *offset >= sb.st_size) {
+		if (*offset > sb.st_size) {
+			warnx("event log %s has shrunk, not read", filename);
+		}
+		if (ps->progress) {
+			printf("Event log: %s (already ingested)\n",
+			       filename);
+		}
+		goto rtn_err;
+	}
+
+	/* Replay a log parsed before rather than parse it again */
+	if (ps->cache && *offset == 0 && S_ISREG(sb.st_mode)) {
+		if (cache_load(ps->cache, filename, &sb, offset, ps) == 0) {
+			if (ps->progress) {
+				printf("Event log: %s (cached)\n", filename);
+			}
+			goto rtn_err;
+		}
+		before  = ps->counts;
+		ps->log = &log;
+	}
+	if (ps->progress && *offset > 0) {
+		printf("Event log: %s (from byte %jd)\n", filename,
+		       (intmax_t)*offset);
+	} else if (ps->progress) {
+		printf("Event log: %s\n", filename);
+	}
+
+	/* Decompress the file as it is parsed */
+	if (fmt != DECOMP_NONE) {
+		if (decomp_open(filename, fd, fmt, &d, &ifp)) {
+			ierr = EXIT_FAILURE;
+			goto rtn_err;
+		}
+		fd = -1;
+		skip = *offset;
+		*offset = 0;
+		ierr = event_read(ifp, skip, 1, offset, vptr);
+		fclose(ifp);
+		ifp = NULL;
+		if (decomp_close(&d)) {
+			ierr = EXIT_FAILURE;
+		}
+		goto rtn_err;
+	}
+
+	if (S_ISREG(sb.st_mode) && sb.st_size > 0) {
+		if (event_map(fd, sb.st_size, offset, vptr) == 0) {
+			goto rtn_err;
+		}
+	}
+
+	/* Fall back to reading the file */
+	if ((ifp = fdopen(fd, "r")) == NULL) {
+		warn("unable to read event log %s", filename);
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+	fd = -1;
+	if (*offset > 0 && fseeko(ifp, *offset, SEEK_SET) == -1) {
+		warn("unable to seek in event log %s", filename);
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+	ierr = event_read(ifp, 0, !S_ISREG(sb.st_mode), offset, vptr);
+
+rtn_err:
+	if (ps->log) {
+		if (ierr == 0) {
+			cache_save(ps->cache, filename, &sb, *offset, &before, ps);
+		}
+		cache_free(&log);
+		ps->log = NULL;
+	}
+	if (ifp) {
+		fclose(ifp);
+		ifp = NULL;
+	}
+
+	if (fd != -1) {
+		close(fd);
+		fd = -1;
+	}
+
+	return(ierr);
+}
+
+/**
+ * Parse the event log file of a single day.
+ *
+ * Only the part of the log not already in the parser's ingested
+ * sources is read, and the sources are then updated.
+ *
+ * @param[in]  stats_dir The MOAB stats directory.
+ * @param[in]  offset    The time offset in days (from today).
+ * @param[in]  vptr      The parser state passed to the event functions.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+event_search(const char *stats_dir,
+	     int32_t offset,
+	     void *vptr)
+{
+	int32_t ierr   = 0;           /* Error number */
+	off_t start    = 0;           /* Bytes already ingested */
+	char *filename = NULL;        /* Event log filename */
+	struct parser *ps = vptr;
+
+	if ((ierr = event_file(offset, stats_dir, &filename)) == 0) {
+		decomp_find(&filename);
+		start = sources_find(ps->sources, filename);
+		if ((ierr = event_parse(filename, &start, vptr)) == 0) {
+			sources_set(ps->sources, filename, start);
+		}
+	}
+
+	if (filename) {
+		free(filename);
+		filename = NULL;
+	}
+
+	return(ierr);
+}
+
+/**
+ * Worker thread for parsing a range of event logs.
+ *
+ * Each worker takes the next unparsed file and parses it into its
+ * own copy of the projects.
+ *
+ * @param[in]  vptr      The shared range state.
+ **/
+static void *
+event_worker(void *vptr)
+{
+	int32_t i        = 0;
+	int32_t ierr     = 0;
+	struct range *r  = (struct range *)vptr;
+	struct parser ps = {0};
+	struct pindex idx = {0};
+
+	for (;;) {
+		/* Wait for the merge to catch up, so few results are held */
+		pthread_mutex_lock(&r->lock);
+		while (r->next < r->nfiles && r->next >= r->merged + r->window) {
+			pthread_cond_wait(&r->cond, &r->lock);
+		}
+		i = r->next++;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+		if (i >= r->nfiles) {
+			break;
+		}
+
+		memset(&ps, 0, sizeof(struct parser));
+		ps.arena = &r->arenas[i];
+		arena_init(ps.arena, PAGE_SIZE);
+		project_clone(r->projects, &ps.projects, ps.arena);
+		project_index(ps.projects, &idx);
+		ps.index = &idx;
+		ps.match = r->match;
+		ps.cache = r->cache;
+		ps.nthreads = r->split;
+		ps.progress = r->progress;
+		ierr = event_parse(r->files[i], &r->offsets[i], &ps);
+		project_index_free(&idx);
+		pthread_mutex_lock(&r->lock);
+		r->results[i] = ps.projects;
+		r->fails[i] = ierr;
+		r->done[i] = 1;
+		counters_add(&r->counts, &ps.counts);
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	return(NULL);
+}
+
+/**
+ * Read the event logs of a range ahead of the workers parsing them.
+ *
+ * The logs are read in order through a buffer that is thrown away, so
+ * that they are in the page cache by the time a worker maps them. This
+ * keeps at most EVENT_AHEAD logs ahead of the last one taken, and skips
+ * any a worker has already taken.
+ *
+ * @param[in]  vptr      The shared range state.
+ **/
+static void *
+event_reader(void *vptr)
+{
+	int32_t i       = 0;
+	int fd          = -1;
+	ssize_t n       = 0;
+	off_t offset    = 0;
+	char *buf       = NULL;
+	struct range *r = (struct range *)vptr;
+
+	buf = xmalloc(EVENT_AHEAD_BUF * sizeof(char));
+	for (i = 0; i < r->nfiles; ++i) {
+		pthread_mutex_lock(&r->lock);
+		while (i >= r->next + EVENT_AHEAD) {
+			pthread_cond_wait(&r->cond, &r->lock);
+		}
+		if (i < r->next) {
+			i = r->next - 1;
+			pthread_mutex_unlock(&r->lock);
+			continue;
+		}
+		offset = r->offsets[i];
+		pthread_mutex_unlock(&r->lock);
+
+		if ((fd = open(r->files[i], O_RDONLY)) == -1) {
+			continue;
+		}
+		posix_fadvise(fd, offset, 0, POSIX_FADV_WILLNEED);
+		while ((n = pread(fd, buf, EVENT_AHEAD_BUF, offset)) > 0) {
+			offset += n;
+		}
+		close(fd);
+	}
+	free(buf);
+
+	return(NULL);
+}
+
+/**
+ * Seconds from an arbitrary point, for timing the writer.
+ *
+ * @return               The seconds.
+ **/
+static double
+event_clock(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1.0e-9);
+}
+
+/**
+ * Take the events of the logs merged so far for the writer.
+ *
+ * The jobs are moved out of the projects, as they are only appended
+ * to the output. The reservations, which a later log may update, and
+ * the ingested logs are copied.
+ *
+ * @param[in,out] ps     The parser state holding the projects.
+ * @return               The batch, to be freed with event_batch_free().
+ **/
+static struct batch *
+event_batch(struct parser *ps)
+{
+	struct batch *b         = NULL;
+	struct project *p       = NULL;
+	struct project *q       = NULL;
+	const struct sources *s = ps->sources;
+
+	b = xmalloc(sizeof(struct batch));
+	memset(b, 0, sizeof(struct batch));
+	arena_init(&b->arena, PAGE_SIZE);
+	project_clone(ps->projects, &b->ps.projects, &b->arena);
+	for (p = ps->projects, q = b->ps.projects; p != NULL;
+	     p = p->next, q = q->next) {
+		q->jobs = p->jobs;
+		memset(&p->jobs, 0, sizeof(struct columns));
+		columns_concat(&q->reservations, &p->reservations);
+	}
+	if (s != NULL && s->n > 0) {
+		b->sources.s = xmalloc(s->n * sizeof(struct source));
+		memcpy(b->sources.s, s->s, s->n * sizeof(struct source));
+		b->sources.n = b->sources.cap = s->n;
+	}
+	b->ps.sources = &b->sources;
+	b->ps.arena   = &b->arena;
+
+	return(b);
+}
+
+/**
+ * Free a batch of merged logs.
+ *
+ * @param[in]  b         The batch.
+ **/
+static void
+event_batch_free(struct batch *b)
+{
+	project_free(b->ps.projects);
+	arena_free(&b->arena);
+	sources_free(&b->sources);
+	free(b);
+}
+
+/**
+ * Writer thread for the merged logs of a range.
+ *
+ * Batches are written in the order they were queued. Once a flush
+ * fails the later batches are dropped, so no log after it is
+ * recorded as ingested.
+ *
+ * @param[in]  vptr      The writer.
+ **/
+static void *
+event_writer(void *vptr)
+{
+	struct writer *w = (struct writer *)vptr;
+	struct batch *b  = NULL;
+	int32_t ierr     = 0;
+	double t         = 0.0;
+
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		while (w->n == 0 && !w->closed) {
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+		if (w->n == 0) {
+			pthread_mutex_unlock(&w->lock);
+			break;
+		}
+		b = w->queue[w->head];
+		ierr = w->ierr;
+		pthread_mutex_unlock(&w->lock);
+
+		t = event_clock();
+		if (ierr == 0) {
+			ierr = w->flush(&b->ps, w->arg);
+		}
+		event_batch_free(b);
+		t = event_clock() - t;
+
+		/* The batch leaves the queue once written, which bounds
+		 * the batches held to EVENT_QUEUE */
+		pthread_mutex_lock(&w->lock);
+		w->ierr |= ierr;
+		w->secs += t;
+		w->head = (w->head + 1) % EVENT_QUEUE;
+		w->n -= 1;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	return(NULL);
+}
+
+/**
+ * Queue a batch of merged logs for the writer.
+ *
+ * This waits while the queue is full. Without a writer thread the
+ * batch is written here instead. Either way, the time the merge is
+ * held up is added to the parser's waiting.
+ *
+ * @param[in,out] w      The writer.
+ * @param[in]  b         The batch, owned by the writer from now on.
+ * @param[in,out] ps     The parser state.
+ * @retval     0         If it was queued
+ * @retval     1         If a flush has failed
+ **/
+static int32_t
+event_queue(struct writer *w,
+	    struct batch *b,
+	    struct parser *ps)
+{
+	int32_t ierr = 0;
+	double t     = event_clock();
+
+	if (!w->running) {
+		ierr = w->ierr || w->flush(&b->ps, w->arg);
+		w->ierr |= ierr;
+		event_batch_free(b);
+		t = event_clock() - t;
+		w->secs     += t;
+		ps->waiting += t;
+		return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	pthread_mutex_lock(&w->lock);
+	while (w->n == EVENT_QUEUE && !w->ierr) {
+		pthread_cond_wait(&w->cond, &w->lock);
+	}
+	ps->waiting += event_clock() - t;
+	if ((ierr = w->ierr) == 0) {
+		w->queue[(w->head + w->n) % EVENT_QUEUE] = b;
+		w->n += 1;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (ierr) {
+		event_batch_free(b);
+	}
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Parse all the event logs within a range of days.
+ *
+ * The range is run as a pipeline. A reader thread reads the files
+ * ahead of the workers, the workers parse the files concurrently, each
+ * into a copy of the projects allocated from an arena of its own, and
+ * the calling thread merges the copies back into the projects in date
+ * order, so reservation updates are applied as if the files were read
+ * in turn. If the parser has a flush, a writer thread then writes each
+ * merged file through it while the later files are merged and parsed.
+ * The jobs of a file are handed to the writer, and so are no longer
+ * held in the projects. Workers do not run more than twice their
+ * number of files ahead of the merge, the merge not more than
+ * EVENT_QUEUE files ahead of the writer, and each copy is freed once
+ * merged, which bounds the memory held.
+ * The first file to fail, in date order, stops that file and those
+ * after it being written or recorded as ingested. Files already in
+ * the ingested sources are only read from where they were left.
+ *
+ * @param[in]  stats_dir The MOAB stats directory.
+ * @param[in]  from      The first day (UTC).
+ * @param[in]  to        The last day (UTC).
+ * @param[in]  nthreads  The number of worker threads.
+ * @param[in,out] ps     The parser state holding the projects.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+event_range(const char *stats_dir,
+	    time_t from,
+	    time_t to,
+	    int32_t nthreads,
+	    struct parser *ps)
+{
+	int32_t i          = 0;
+	int32_t ierr       = 0;
+	int32_t failed     = 0;
+	int32_t ahead      = 0;             /* The reader was started */
+	double t           = 0.0;
+	pthread_t reader;
+	pthread_t writer;
+	pthread_t *tids    = NULL;
+	struct range r     = {0};
+	struct writer w    = {0};
+
+	if ((ierr = event_files(stats_dir, from, to, &r.files, &r.nfiles))) {
+		return(ierr);
+	}
+
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+	if (nthreads > r.nfiles) {
+		r.split  = nthreads / r.nfiles;
+		nthreads = r.nfiles;
+	} else {
+		r.split  = 1;
+	}
+
+	pthread_mutex_init(&r.lock, NULL);
+	pthread_cond_init(&r.cond, NULL);
+	r.window   = 2 * nthreads;
+	r.progress = ps->progress;
+	r.projects = ps->projects;
+	r.match    = ps->match;
+	r.cache    = ps->cache;
+	r.offsets  = xmalloc(r.nfiles * sizeof(off_t));
+	for (i = 0; i < r.nfiles; ++i) {
+		r.offsets[i] = sources_find(ps->sources, r.files[i]);
+	}
+	r.results  = xmalloc(r.nfiles * sizeof(struct project *));
+	r.arenas   = xmalloc(r.nfiles * sizeof(struct arena));
+	r.done     = xmalloc(r.nfiles * sizeof(int32_t));
+	memset(r.done, 0, r.nfiles * sizeof(int32_t));
+	r.fails    = xmalloc(r.nfiles * sizeof(int32_t));
+	memset(r.fails, 0, r.nfiles * sizeof(int32_t));
+	tids       = xmalloc(nthreads * sizeof(pthread_t));
+
+	/* Reading ahead only helps, the range is parsed without it */
+	ahead = (pthread_create(&reader, NULL, event_reader, &r) == 0);
+
+	/* Without a writer thread each file is written as it is merged */
+	pthread_mutex_init(&w.lock, NULL);
+	pthread_cond_init(&w.cond, NULL);
+	w.flush = ps->flush;
+	w.arg   = ps->flush_arg;
+	if (ps->flush) {
+		w.running = (pthread_create(&writer, NULL, event_writer,
+					    &w) == 0);
+	}
+	for (i = 0; i < nthreads; ++i) {
+		if (pthread_create(&tids[i], NULL, event_worker, &r)) {
+			warnx("unable to create worker thread");
+			break;
+		}
+	}
+	nthreads = i;
+	if (nthreads == 0) {
+		/* Nothing will parse the files, let the reader finish */
+		pthread_mutex_lock(&r.lock);
+		r.next = r.nfiles;
+		pthread_cond_broadcast(&r.cond);
+		pthread_mutex_unlock(&r.lock);
+		failed = EXIT_FAILURE;
+	}
+
+	/* Merge, and write, the results in file order as they complete */
+	for (i = 0; i < r.nfiles; ++i) {
+		if (nthreads == 0) {
+			free(r.files[i]);
+			continue;
+		}
+		pthread_mutex_lock(&r.lock);
+		while (!r.done[i]) {
+			pthread_cond_wait(&r.cond, &r.lock);
+		}
+		/* Logs after one that failed are merged, but not written */
+		failed |= r.fails[i];
+		pthread_mutex_unlock(&r.lock);
+
+		if (r.results[i]) {
+			if (project_merge(ps->projects, r.results[i])) {
+				ierr = EXIT_FAILURE;
+			}
+			project_free(r.results[i]);
+		}
+		/* The merge copied the events, the copy is no longer needed */
+		arena_free(&r.arenas[i]);
+
+		pthread_mutex_lock(&r.lock);
+		r.merged = i + 1;
+		pthread_cond_broadcast(&r.cond);
+		pthread_mutex_unlock(&r.lock);
+
+		if (failed == 0) {
+			sources_set(ps->sources, r.files[i], r.offsets[i]);
+			if (ps->flush && event_queue(&w, event_batch(ps), ps)) {
+				failed = EXIT_FAILURE;
+			}
+		}
+		free(r.files[i]);
+	}
+
+	for (i = 0; i < nthreads; ++i) {
+		pthread_join(tids[i], NULL);
+	}
+	if (ahead) {
+		pthread_join(reader, NULL);
+	}
+	if (w.running) {
+		t = event_clock();
+		pthread_mutex_lock(&w.lock);
+		w.closed = 1;
+		pthread_cond_broadcast(&w.cond);
+		pthread_mutex_unlock(&w.lock);
+		pthread_join(writer, NULL);
+		ps->waiting += event_clock() - t;
+	}
+	ps->flushing += w.secs;
+	if (w.ierr) {
+		failed = EXIT_FAILURE;
+	}
+	if (failed) {
+		ierr = EXIT_FAILURE;
+	}
+	counters_add(&ps->counts, &r.counts);
+
+	pthread_cond_destroy(&w.cond);
+	pthread_mutex_destroy(&w.lock);
+	pthread_cond_destroy(&r.cond);
+	pthread_mutex_destroy(&r.lock);
+	free(r.done);
+	free(r.fails);
+	free(r.results);
+	free(r.offsets);
+	free(r.arenas);
+	free(r.files);
+	free(tids);
+
+	return(ierr);
+}
+
+/**
+ * Check a span of a line starts with at least one digit.
+ *
+ * @param[in]  ptr       The start of the span.
+ * @param[in]  end       The end of the line.
+ * @return               The end of the digits, or NULL if there are none.
+ **/
+static const char *
+event_digits(const char *ptr,
+	     const char *end)
+{
+	const char *d = ptr;
+
+	while (d < end && isdigit((unsigned char)*d)) {
+		++d;
+	}
+	return(d == ptr ? NULL : d);
+}
+
+/**
+ * Find the value of a key within a line.
+ *
+ * @param[in]  ptr       Where to start searching.
+ * @param[in]  end       The end of the line.
+ * @param[in]  key       The key, including the '='.
+ * @param[in]  nkey      The length of the key.
+ * @return               The start of the value, or NULL if not found.
+ **/
+static const char *
+event_value(const char *ptr,
+	    const char *end,
+	    const char *key,
+	    size_t nkey)
+{
+	ptr = scan_find(ptr, end - ptr, key, nkey);
+	return(ptr ? ptr + nkey : NULL);
+}
+
+/**
+ * Find the reservation named by the REQRSV of a JOBEND record.
+ *
+ * This is only needed for names the matcher does not know. The name
+ * runs to the end of the value, less any -NNz epoch.
+ *
+ * @param[in]  line      The line, terminated at line[n].
+ * @param[in]  n         The length of the line.
+ * @param[out] nlen      The length of the name.
+ * @return               The start of the name.
+ **/
+static const char *
+event_reqrsv(const char *restrict line,
+	     size_t n,
+	     size_t *nlen)
+{
+	const char *ptr = NULL;
+	const char *val = NULL;
+	const char *end = line + n;
+
+	if ((val = event_value(line, end, MATCH_KEY, sizeof(MATCH_KEY) - 1))
+	    == NULL) {
+		*nlen = 0;
+		return(line);
+	}
+	for (ptr = val; ptr < end && *ptr != ' '; ++ptr) {
+	}
+	if (ptr - val >= 4 && ptr[-1] == 'z' &&
+	    isdigit((unsigned char)ptr[-2]) &&
+	    isdigit((unsigned char)ptr[-3]) && ptr[-4] == '-') {
+		ptr -= 4;
+	}
+	*nlen = ptr - val;
+
+	return(val);
+}
+
+/**
+ * Scan a RSVEND record for the reservation fields.
+ *
+ * The record must contain, in order,
+ *   NAME=<name>-<NN>z.<id> ... STARTTIME=<n> ...
+ *   ENDTIME=<n> ... ALLOCTC=<n>
+ * where <name> is made of letters, digits and '-'.
+ *
+ * @param[in]  line      The line, terminated at line[n].
+ * @param[in]  n         The length of the line.
+ * @param[out] r         The fields found.
+ * @retval     0         If the fields were found
+ * @retval     1         If any is missing
+ **/
+static int32_t
+event_rsv_scan(const char *restrict line,
+	       size_t n,
+	       struct rsvend *r)
+{
+	const char *ptr  = line;
+	const char *nend = NULL;
+	const char *end  = line + n;
+
+	/* NAME=<name>-<NN>z.<id> */
+	while ((ptr = event_value(ptr, end, "NAME=", 5)) != NULL) {
+		r->name = ptr;
+		while (ptr < end && (isalnum((unsigned char)*ptr) ||
+				     *ptr == '-')) {
+			++ptr;
+		}
+		nend = ptr;
+		if (nend - r->name >= 5    &&
+		    nend[-1] == 'z'        &&
+		    isdigit((unsigned char)nend[-2]) &&
+		    isdigit((unsigned char)nend[-3]) &&
+		    nend[-4] == '-'        &&
+		    ptr < end && *ptr == '.' &&
+		    event_digits(ptr + 1, end) != NULL) {
+			r->nname = nend - 4 - r->name;
+			r->epoch = nend - 3;
+			r->id    = ptr + 1;
+			break;
+		}
+	}
+	if (ptr == NULL) {
+		return(EXIT_FAILURE);
+	}
+
+	if ((ptr = event_value(ptr, end, "STARTTIME=", 10)) == NULL ||
+	    event_digits(ptr, end) == NULL) {
+		return(EXIT_FAILURE);
+	}
+	r->start = ptr;
+
+	if ((ptr = event_value(ptr, end, "ENDTIME=", 8)) == NULL ||
+	    event_digits(ptr, end) == NULL) {
+		return(EXIT_FAILURE);
+	}
+	r->end = ptr;
+
+	if ((ptr = event_value(ptr, end, "ALLOCTC=", 8)) == NULL ||
+	    event_digits(ptr, end) == NULL) {
+		return(EXIT_FAILURE);
+	}
+	r->nodes = ptr;
+
+	return(EXIT_SUCCESS);
+}
+
+int32_t
+event_none(const char *restrict line ATT_UNUSED,
+	   size_t n ATT_UNUSED,
+	   void *vptr ATT_UNUSED
+	   )
+{
+	return(EXIT_SUCCESS);
+}
+
+int32_t
+event_rsv(const char *restrict line,
+	  size_t n,
+	  void *vptr
+	  )
+{
+	int64_t id            = 0;
+	int64_t start         = 0;
+	int64_t end           = 0;
+	int64_t nodes         = 0;
+	struct rsvend r       = {0};
+	struct event res      = {0};
+	struct project *p     = NULL;
+	struct parser *ps     = (struct parser *)vptr;
+	const char *lend      = line + n;
+
+	if (event_rsv_scan(line, n, &r) != 0) {
+		return(EXIT_SUCCESS);
+	}
+
+	/* Search for the reservation within the projects, every
+	 * reservation is kept when caching */
+	p = project_find(ps->index, r.name, r.nname);
+	if (p == NULL && ps->log == NULL) {
+		return(EXIT_SUCCESS);
+	}
+	if (scan_int(r.id, lend, &id)          ||
+	    scan_time(r.start, lend, &start)   ||
+	    scan_time(r.end, lend, &end)       ||
+	    scan_int(r.nodes, lend, &nodes)) {
+		if (ps->log) {
+			cache_put(ps->log, CACHE_RSV_BAD, r.name, r.nname, NULL);
+		}
+		ps->counts.malformed += (p != NULL);
+		return(EXIT_FAILURE);
+	}
+	res.epoch = (r.epoch[0] - '0') * 10 + (r.epoch[1] - '0');
+	res.id    = id;
+	res.start = start;
+	res.end   = end;
+	res.nodes = nodes;
+	if (ps->log) {
+		cache_put(ps->log, CACHE_RSV, r.name, r.nname, &res);
+	}
+	if (p != NULL) {
+		project_add_rsv(p, &res);
+		ps->counts.rsvs += 1;
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+int32_t
+event_job(const char *restrict line,
+	  size_t n,
+	  void *vptr
+	  )
+{
+	static const char knodes[] = "REQUESTEDNC";
+	static const char kstart[] = "STARTTIME";
+	static const char kend[]   = "COMPLETETIME";
+	static const char kid[]    = "DRMJID";
+	int32_t seen          = 0;
+	size_t nlen           = 0;
+	size_t nval           = 0;
+	int64_t v             = 0;
+	uint8_t epoch         = 0;
+	char *ptr             = NULL;
+	char *sptr            = NULL;
+	const char *val       = NULL;
+	const char *end       = line + n;
+	struct event job      = {0};
+	struct tokens tk;
+	struct project *p     = NULL;
+	struct parser *ps     = (struct parser *)vptr;
+
+	/* Look for REQRSV=<known reservation>, most jobs have none */
+	ptr = (char *)matcher_find(ps->match, line, n, &nlen, &seen);
+	if (ptr == NULL) {
+		if (seen) {
+			ps->counts.unmatched += 1;
+		}
+		/* Every reservation is kept when caching */
+		if (!seen || ps->log == NULL) {
+			return(EXIT_SUCCESS);
+		}
+		ptr = (char *)event_reqrsv(line, n, &nlen);
+	} else if ((p = project_find(ps->index, ptr, nlen)) == NULL) {
+		return(EXIT_SUCCESS);
+	}
+
+	/* The name may be followed by -NNz */
+	sptr = ptr + nlen;
+	if (sptr < end && *sptr == '-') {
+		epoch = (sptr[1] - '0') * 10 + (sptr[2] - '0');
+	}
+
+	job.epoch = epoch;
+
+	/* Split the record into its fields, once */
+	scan_tokens(line, n, &tk);
+
+	/* Look for the node count */
+	job.nodes = 1;
+	if ((val = scan_value(&tk, line, knodes, sizeof(knodes) - 1,
+			      &nval))) {
+		if (scan_int(val, end, &job.nodes)) {
+			goto malformed;
+		}
+	}
+
+	/* Look for the STARTTIME */
+	if (!(val = scan_value(&tk, line, kstart, sizeof(kstart) - 1,
+			       &nval))) {
+		goto none;
+	}
+	if (scan_time(val, end, &v)) {
+		goto malformed;
+	}
+	job.start = v;
+
+	/* Look for the COMPLETETIME */
+	if (!(val = scan_value(&tk, line, kend, sizeof(kend) - 1, &nval))) {
+		goto none;
+	}
+	if (scan_time(val, end, &v)) {
+		goto malformed;
+	}
+	job.end = v;
+
+	/* Look for the job id */
+	if (!(val = scan_value(&tk, line, kid, sizeof(kid) - 1, &nval))) {
+		goto none;
+	}
+	if (scan_int(val, end, &job.id)) {
+		goto malformed;
+	}
+
+	if (ps->log) {
+		cache_put(ps->log, CACHE_JOB, ptr, nlen, &job);
+	}
+	if (p != NULL) {
+		columns_append(&p->jobs, &job);
+		ps->counts.jobs += 1;
+	}
+
+	return(EXIT_SUCCESS);
+
+none:
+	if (ps->log) {
+		cache_put(ps->log, CACHE_JOB_NONE, ptr, nlen, NULL);
+	}
+	return(EXIT_SUCCESS);
+
+malformed:
+	if (ps->log) {
+		cache_put(ps->log, CACHE_JOB_BAD, ptr, nlen, NULL);
+	}
+	ps->counts.malformed += (p != NULL);
+	return(EXIT_FAILURE);
+}
+
 
 /**
  * \}
@@ -42,43 +42,256 @@ extern "C"
 {
 #endif
 
-#define V_STRCMP        _SIDD_UBYTE_OPS|_SIDD_CMP_EQUAL_EACH|_SIDD_MASKED_POSITIVE_POLARITY
+/** Filename format of the daily event logs (strftime/strptime) **/
+#define EVENT_FORMAT    "events.%a_%b_%d_%Y"
 
-#define X_QUOTE(a)      ((#a)[0])
-#define X_ENUM(a, b)    a =(int)b
-#define X_ARRAY(a, b)   [a] = b,
-#define X_PROTO(a, b)   int b(const char *restrict, void *);
+/** Fewest bytes of an event log worth giving a thread of its own **/
+#define EVENT_SPLIT_MIN (1 << 20)
+
+/** Event logs of a range read ahead of those being parsed **/
+#define EVENT_AHEAD     2
+
+/** Size of the buffer event logs are read ahead through **/
+#define EVENT_AHEAD_BUF (8 << 20)
+
+/** Merged event logs of a range queued for the parser's flush **/
+#define EVENT_QUEUE     2
+
+#define X_NAME(a, b)    #a,
+#define X_ENUM(a, b)    EVENT_##a,
+#define X_ARRAY(a, b)   b,
+#define X_PROTO(a, b)   int b(const char *restrict, size_t, void *);
 
 /** Event table.
- * Provides a lookup table/array. The elements are
- * - single letter that is the first letter of the event name in the
- *   event log file.
- * - function name to process that event line.
+ * Every MOAB record type and the function to process a line of that
+ * type. Lines of a type handled by event_none are only counted. The
+ * record types are dispatched through a perfect hash, which mkevents
+ * generates from this table at build time (events_hash.h).
+ **/
+#define EVENTS_TABLE(X)                         \
+	X(ALLSCHEDCOMMAND,      event_none)     \
+	X(CLIENTCOMMAND,        event_none)     \
+	X(GEVENT,               event_none)     \
+	X(JOBCANCEL,            event_none)     \
+	X(JOBCHECKPOINT,        event_none)     \
+	X(JOBEND,               event_job)      \
+	X(JOBFAILURE,           event_none)     \
+	X(JOBHOLD,              event_none)     \
+	X(JOBMIGRATE,           event_none)     \
+	X(JOBMODIFY,            event_none)     \
+	X(JOBPREEMPT,           event_none)     \
+	X(JOBREJECT,            event_none)     \
+	X(JOBRELEASE,           event_none)     \
+	X(JOBRESUME,            event_none)     \
+	X(JOBSTART,             event_none)     \
+	X(JOBSUBMIT,            event_none)     \
+	X(JOBVARSET,            event_none)     \
+	X(JOBVARUNSET,          event_none)     \
+	X(NODEDOWN,             event_none)     \
+	X(NODEFAILURE,          event_none)     \
+	X(NODEMODIFY,           event_none)     \
+	X(NODEUP,               event_none)     \
+	X(NOTE,                 event_none)     \
+	X(QOSVIOLATION,         event_none)     \
+	X(RMDOWN,               event_none)     \
+	X(RMPOLLEND,            event_none)     \
+	X(RMPOLLSTART,          event_none)     \
+	X(RMUP,                 event_none)     \
+	X(RSVCANCEL,            event_none)     \
+	X(RSVCREATE,            event_none)     \
+	X(RSVEND,               event_rsv)      \
+	X(RSVMODIFY,            event_none)     \
+	X(RSVSTART,             event_none)     \
+	X(SCHEDCOMMAND,         event_none)     \
+	X(SCHEDCYCLEEND,        event_none)     \
+	X(SCHEDCYCLESTART,      event_none)     \
+	X(SCHEDEND,             event_none)     \
+	X(SCHEDFAILURE,         event_none)     \
+	X(SCHEDMODIFY,          event_none)     \
+	X(SCHEDPAUSE,           event_none)     \
+	X(SCHEDRECYCLE,         event_none)     \
+	X(SCHEDRESUME,          event_none)     \
+	X(SCHEDSTART,           event_none)     \
+	X(TRIGEND,              event_none)     \
+	X(TRIGFAILURE,          event_none)     \
+	X(TRIGSTART,            event_none)     \
+	X(TRIGTHRESHOLD,        event_none)     \
+	X(VMCREATE,             event_none)     \
+	X(VMDESTROY,            event_none)     \
+	X(VMMIGRATE,            event_none)     \
+	X(VMPOWEROFF,           event_none)     \
+	X(VMPOWERON,            event_none)
+
+/** The record types, in the order of the event table **/
+enum event_type {
+	EVENTS_TABLE(X_ENUM)
+	EVENT_TYPES                     /* Number of record types */
+};
+
+/** The names of the record types **/
+extern const char *const event_names[EVENT_TYPES];
+
+/**
+ * Hash a record type for the perfect hash dispatch (32 bit FNV-1a).
+ *
+ * @param[in]  s         The record type, need not be NUL terminated.
+ * @param[in]  n         The length of the record type.
+ * @param[in]  seed      The seed chosen by mkevents.
+ * @return               The hash.
  **/
-#define EVENTS_TABLE(X)    \
-	X('j', event_job)  \
-	X('r', event_rsv)
+static inline uint32_t
+event_hash(const char *s,
+	   size_t n,
+	   uint32_t seed)
+{
+	size_t i   = 0;
+	uint32_t h = seed;
+
+	for (i = 0; i < n; ++i) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return(h ^ (h >> 16));
+}
+
+/** Where the record type is within the lines of an event log **/
+struct layout {
+	int32_t field;                  /* Field of the type, -1 if unknown */
+	int32_t off;                    /* Its column in the last line */
+};
+
+/** Layout of an event log that has not been looked at yet **/
+#define LAYOUT_INIT     {-1, 0}
 
-/** Linked list structure for events **/
+/** A single event record **/
 struct event {
 	uint8_t epoch;
 	int64_t id;
 	int64_t nodes;
 	time_t  start;
 	time_t  end;
-	char    *name;
-	struct event *next;
 };
 
-/** Function pointer definition for a line matching an event **/
-typedef int (*event_fp)(const char *restrict, void *);
+/** Growable structure-of-arrays store of events.
+ * Each field of struct event is held in its own array, so a column
+ * can be handed to HDF5 as it is.
+ **/
+struct columns {
+	int64_t n;                      /* Number of events */
+	int64_t cap;                    /* Capacity of each column */
+	uint8_t *epochs;
+	int64_t *ids;
+	int64_t *nodes;
+	int64_t *starts;
+	int64_t *ends;
+};
+
+/** Longest event log name that can be recorded as ingested **/
+#define SOURCE_NAME_MAX 64
+
+/** An event log that has been ingested, and how much of it **/
+struct source {
+	char  name[SOURCE_NAME_MAX];    /* Base name of the log */
+	int64_t size;                   /* Bytes ingested */
+};
+
+/** The event logs that have been ingested **/
+struct sources {
+	int32_t n;                      /* Number of logs */
+	int32_t cap;                    /* Capacity of the array */
+	struct source *s;
+};
+
+/** What a parser has read and matched **/
+struct counters {
+	int64_t lines;                  /* Lines read */
+	int64_t bytes;                  /* Bytes read */
+	int64_t jobs;                   /* JOBEND records added */
+	int64_t rsvs;                   /* RSVEND records matched */
+	int64_t unmatched;              /* JOBEND with an unknown REQRSV */
+	int64_t malformed;              /* Matched records with a bad field */
+	int64_t other;                  /* Lines of no known record type */
+	int64_t types[EVENT_TYPES];     /* Lines by record type */
+};
+
+struct project;
+struct pindex;
+struct arena;
+struct matcher;
+struct cache_log;
+
+/** State handed to the event functions while parsing a log **/
+struct parser {
+	struct project *projects;       /* Projects to add events to */
+	const struct pindex *index;     /* Index of the projects by name */
+	const struct matcher *match;    /* Matcher of the project names */
+	struct arena *arena;            /* Memory for the projects */
+	struct sources *sources;        /* Logs already ingested, or NULL */
+	int32_t nthreads;               /* Threads to split a log between */
+	int32_t progress;               /* Print each log as it is parsed */
+	const char *cache;              /* Cache directory, or NULL */
+	struct cache_log *log;          /* Records to cache, or NULL */
+	struct counters counts;         /* What has been parsed */
+	int32_t (*flush)(struct parser *, void *); /* Writes merged logs */
+	void *flush_arg;                /* Handed to flush, if not NULL */
+	double flushing;                /* Seconds spent in flush */
+	double waiting;                 /* Seconds parsing waited on flush */
+};
+
+/** Function pointer definition for a line matching an event.
+ * The line is not NUL terminated, it is followed by either a
+ * newline or a NUL at line[n].
+ **/
+typedef int (*event_fp)(const char *restrict, size_t, void *);
 
 /** Obtain the full path to an event log file **/
 int event_file(int32_t, const char *, char **);
 
+/** Obtain the full path to the event log file of a day **/
+int event_name(time_t, const char *, char **);
+
+/** Find all the event log files within a range of days **/
+int event_files(const char *, time_t, time_t, char ***, int32_t *);
+
 /** Parse an event log file for reservation records **/
+int event_parse(const char *, off_t *, void *);
+
+/** Parse the complete lines within a buffer **/
+size_t event_lines(const char *, size_t, struct layout *, void *);
+
+/** Parse the event log file of a single day **/
 int event_search(const char *, int32_t, void *);
 
+/** Parse all the event log files within a range of days **/
+int event_range(const char *, time_t, time_t, int32_t, struct parser *);
+
+/** Make room for a number of events in a set of columns **/
+void columns_reserve(struct columns *, int64_t);
+
+/** Append an event to a set of columns **/
+int64_t columns_append(struct columns *, const struct event *);
+
+/** Append all of the events in one set of columns to another **/
+void columns_concat(struct columns *, const struct columns *);
+
+/** Read an event from a set of columns **/
+void columns_get(const struct columns *, int64_t, struct event *);
+
+/** Free a set of columns **/
+void columns_free(struct columns *);
+
+/** Find how much of an event log has been ingested **/
+int64_t sources_find(const struct sources *, const char *);
+
+/** Record how much of an event log has been ingested **/
+void sources_set(struct sources *, const char *, int64_t);
+
+/** Free a list of ingested event logs **/
+void sources_free(struct sources *);
+
+/** Add one set of parser counters to another **/
+void counters_add(struct counters *, const struct counters *);
+
 /** Generate event function pointers definitions **/
 EVENTS_TABLE(X_PROTO)
 
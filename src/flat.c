@@ -0,0 +1,638 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file flat.c
+ * Cluster-wide tables of events, sorted by project.
+ *
+ * The flat layout holds one jobs table and one reservations table for
+ * the whole cluster, instead of a group of each for every project.
+ * The rows are sorted by project, a dictionary of the project names
+ * is kept in FLAT_PROJECTS, and an offsets dataset next to each table
+ * gives where each project's rows start, so a project is one
+ * contiguous hyperslab and a cluster-wide scan is a sequential read.
+ *
+ * New jobs have to be placed within the rows of their project, so the
+ * tables are rewritten in full whenever they are written.
+ *
+ * \ingroup io
+ * \{
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <err.h>
+#include <hdf5.h>
+
+#include "config.h"
+#include "mem.h"
+#include "args.h"
+#include "events.h"
+#include "projects.h"
+#include "join.h"
+#include "io.h"
+#include "flat.h"
+
+/** A project of the tables being written **/
+struct flat_entry {
+	const char *name;               /* Project name */
+	const struct project *p;        /* The project held, or NULL */
+	int32_t old;                    /* Index in the old dictionary, or -1 */
+};
+
+/** Names of the utilisation datasets, in the order they are held **/
+static const char *const flat_usage[3] = {"used", "idle", "jobs"};
+
+/** Local static functions **/
+static hid_t flat_name_type(void);
+static int32_t flat_find(const struct flat *, const char *);
+static int flat_cmp(const void *, const void *);
+static void flat_view(const struct columns *, int64_t, int64_t,
+		      struct columns *);
+static int32_t flat_slice(hid_t, int64_t, int64_t, struct columns *);
+static int32_t flat_hyperslab(hid_t, const char *, void *, int64_t, int64_t,
+			      hid_t, int32_t);
+
+/**
+ * Load the project dictionary of a file.
+ *
+ * A file without a dictionary yet starts with no projects.
+ *
+ * @param[in,out] io     The open file.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+flat_open(struct io *io)
+{
+	int32_t ierr   = 0;
+	hid_t did      = 0;
+	hid_t sid      = 0;
+	hid_t gid      = 0;
+	hid_t tid      = 0;
+	hsize_t dims   = 0;
+	struct flat *f = NULL;
+
+	f = xmalloc(sizeof(struct flat));
+	memset(f, 0, sizeof(struct flat));
+	io->flat = f;
+	if (H5Lexists(io->fid, FLAT_PROJECTS, H5P_DEFAULT) > 0) {
+		did = H5Dopen(io->fid, FLAT_PROJECTS, H5P_DEFAULT);
+		sid = H5Dget_space(did);
+		H5Sget_simple_extent_dims(sid, &dims, NULL);
+		H5Sclose(sid);
+		H5Dclose(did);
+	}
+
+	f->n     = dims;
+	f->names = xmalloc((dims + 1) * FLAT_NAME_MAX * sizeof(char));
+	f->joff  = xmalloc((dims + 1) * sizeof(int64_t));
+	f->roff  = xmalloc((dims + 1) * sizeof(int64_t));
+	f->joff[0] = 0;
+	f->roff[0] = 0;
+	if (dims == 0) {
+		return(EXIT_SUCCESS);
+	}
+
+	tid = flat_name_type();
+	ierr |= io_read_data(io->fid, FLAT_PROJECTS, f->names, f->n, tid);
+	H5Tclose(tid);
+	gid = H5Gopen(io->fid, "jobs", H5P_DEFAULT);
+	ierr |= io_read_data(gid, FLAT_OFFSETS, f->joff, f->n + 1,
+			     H5T_NATIVE_INT64);
+	H5Gclose(gid);
+	gid = H5Gopen(io->fid, "reservations", H5P_DEFAULT);
+	ierr |= io_read_data(gid, FLAT_OFFSETS, f->roff, f->n + 1,
+			     H5T_NATIVE_INT64);
+	H5Gclose(gid);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Free the project dictionary.
+ *
+ * @param[in,out] io     The open file.
+ **/
+void
+flat_close(struct io *io)
+{
+	if (io->flat == NULL) {
+		return;
+	}
+	free(io->flat->names);
+	free(io->flat->joff);
+	free(io->flat->roff);
+	free(io->flat);
+	io->flat = NULL;
+}
+
+/**
+ * Write all projects as cluster-wide tables.
+ *
+ * Projects in the file but not in the list keep their rows. A listed
+ * project keeps the jobs already written, followed by its new jobs,
+ * and its reservations are written over the old ones. The utilisation
+ * already written is kept for the reservations that were written
+ * before, in the same rows, and is zero for new ones until the join
+ * writes it.
+ *
+ * @param[in,out] io     The open file.
+ * @param[in]  p         The list of projects to write.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+flat_write(struct io *io, const struct project *p)
+{
+	int32_t i          = 0;
+	int32_t j          = 0;
+	int32_t k          = 0;
+	int32_t n          = 0;
+	int32_t ierr       = 0;
+	int64_t m          = 0;
+	hid_t gid          = 0;
+	hid_t tid          = 0;
+	char *seen         = NULL;
+	struct flat *f     = io->flat;
+	struct flat nf     = {0};
+	struct flat_entry *e = NULL;
+	const struct project *q = NULL;
+	struct columns oj  = {0};
+	struct columns or  = {0};
+	struct columns nj  = {0};
+	struct columns nr  = {0};
+	struct columns v   = {0};
+	int64_t *ou[3]     = {NULL, NULL, NULL};
+	int64_t *nu[3]     = {NULL, NULL, NULL};
+
+	for (q = p; q != NULL; q = q->next) {
+		++n;
+	}
+	e = xmalloc((f->n + n + 1) * sizeof(struct flat_entry));
+	seen = xmalloc((f->n + 1) * sizeof(char));
+	memset(seen, 0, (f->n + 1) * sizeof(char));
+
+	/* The projects held, then those only in the file, by name */
+	n = 0;
+	for (q = p; q != NULL; q = q->next) {
+		if (strlen(q->name) >= FLAT_NAME_MAX) {
+			warnx("project name %s is too long for the flat layout",
+			      q->name);
+			ierr = EXIT_FAILURE;
+			goto rtn_err;
+		}
+		if ((k = flat_find(f, q->name)) >= 0) {
+			seen[k] = 1;
+		}
+		e[n].name = q->name;
+		e[n].p    = q;
+		e[n].old  = k;
+		++n;
+	}
+	for (k = 0; k < f->n; ++k) {
+		if (!seen[k]) {
+			e[n].name = f->names[k];
+			e[n].p    = NULL;
+			e[n].old  = k;
+			++n;
+		}
+	}
+	qsort(e, n, sizeof(struct flat_entry), flat_cmp);
+
+	/* The rows already written */
+	if (f->n > 0) {
+		ierr |= io_read_events(H5Gopen(io->fid, "jobs", H5P_DEFAULT),
+				       &oj);
+		ierr |= io_read_events(H5Gopen(io->fid, "reservations",
+					       H5P_DEFAULT), &or);
+		if (H5Lexists(io->fid, JOIN_GROUP, H5P_DEFAULT) > 0) {
+			gid = H5Gopen(io->fid, JOIN_GROUP, H5P_DEFAULT);
+			for (j = 0; j < 3; ++j) {
+				ou[j] = xmalloc((or.n + 1) * sizeof(int64_t));
+				ierr |= io_read_data(gid, flat_usage[j], ou[j],
+						     or.n, H5T_NATIVE_INT64);
+			}
+			H5Gclose(gid);
+		}
+		if (ierr) {
+			goto rtn_err;
+		}
+	}
+
+	/* Lay the projects out one after another */
+	nf.n     = n;
+	nf.names = xmalloc((n + 1) * FLAT_NAME_MAX * sizeof(char));
+	nf.joff  = xmalloc((n + 1) * sizeof(int64_t));
+	nf.roff  = xmalloc((n + 1) * sizeof(int64_t));
+	memset(nf.names, 0, (n + 1) * FLAT_NAME_MAX * sizeof(char));
+	for (i = 0; i < n; ++i) {
+		k = e[i].old;
+		memcpy(nf.names[i], e[i].name, strlen(e[i].name));
+		nf.joff[i] = nj.n;
+		nf.roff[i] = nr.n;
+		if (k >= 0) {
+			flat_view(&oj, f->joff[k], f->joff[k + 1], &v);
+			columns_concat(&nj, &v);
+		}
+		if (e[i].p) {
+			columns_concat(&nj, &e[i].p->jobs);
+			columns_concat(&nr, &e[i].p->reservations);
+		} else {
+			flat_view(&or, f->roff[k], f->roff[k + 1], &v);
+			columns_concat(&nr, &v);
+		}
+	}
+	nf.joff[n] = nj.n;
+	nf.roff[n] = nr.n;
+
+	for (j = 0; j < 3; ++j) {
+		nu[j] = xmalloc((nr.n + 1) * sizeof(int64_t));
+		memset(nu[j], 0, (nr.n + 1) * sizeof(int64_t));
+		for (i = 0; ou[j] && i < n; ++i) {
+			if ((k = e[i].old) < 0) {
+				continue;
+			}
+			m = f->roff[k + 1] - f->roff[k];
+			if (m > nf.roff[i + 1] - nf.roff[i]) {
+				m = nf.roff[i + 1] - nf.roff[i];
+			}
+			memcpy(nu[j] + nf.roff[i], ou[j] + f->roff[k],
+			       m * sizeof(int64_t));
+		}
+	}
+
+	/* Write the tables over the old ones */
+	if ((gid = io_group(io->fid, "jobs")) < 0) {
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+	ierr |= io_write_events(io, gid, &nj, 0);
+	ierr |= io_write_data(io, gid, FLAT_OFFSETS, nf.joff, n + 1,
+			      H5T_NATIVE_INT64, 0);
+	H5Gclose(gid);
+	if ((gid = io_group(io->fid, "reservations")) < 0) {
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+	ierr |= io_write_events(io, gid, &nr, 0);
+	ierr |= io_write_data(io, gid, FLAT_OFFSETS, nf.roff, n + 1,
+			      H5T_NATIVE_INT64, 0);
+	H5Gclose(gid);
+	if ((gid = io_group(io->fid, JOIN_GROUP)) < 0) {
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+	for (j = 0; j < 3; ++j) {
+		ierr |= io_write_data(io, gid, flat_usage[j], nu[j], nr.n,
+				      H5T_NATIVE_INT64, 0);
+	}
+	H5Gclose(gid);
+	tid = flat_name_type();
+	ierr |= io_write_data(io, io->fid, FLAT_PROJECTS, nf.names, n, tid, 0);
+	H5Tclose(tid);
+
+	/* The new dictionary replaces the old */
+	free(f->names);
+	free(f->joff);
+	free(f->roff);
+	*f = nf;
+	memset(&nf, 0, sizeof(struct flat));
+
+rtn_err:
+	for (j = 0; j < 3; ++j) {
+		free(ou[j]);
+		free(nu[j]);
+	}
+	free(nf.names);
+	free(nf.joff);
+	free(nf.roff);
+	columns_free(&oj);
+	columns_free(&or);
+	columns_free(&nj);
+	columns_free(&nr);
+	free(seen);
+	free(e);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Read the reservations of a project from the tables.
+ *
+ * The reservations are added to the project as if they had been
+ * parsed, so later records can update them.
+ *
+ * @param[in]  io        The open file.
+ * @param[in,out] p      The project.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+flat_read(struct io *io, struct project *p)
+{
+	int64_t i        = 0;
+	int32_t k        = 0;
+	int32_t ierr     = 0;
+	hid_t gid        = 0;
+	struct event e   = {0};
+	struct columns c = {0};
+	const struct flat *f = io->flat;
+
+	if ((k = flat_find(f, p->name)) < 0) {
+		return(EXIT_SUCCESS);
+	}
+	gid = H5Gopen(io->fid, "reservations", H5P_DEFAULT);
+	ierr = flat_slice(gid, f->roff[k], f->roff[k + 1], &c);
+	H5Gclose(gid);
+	for (i = 0; i < c.n; ++i) {
+		columns_get(&c, i, &e);
+		project_add_rsv(p, &e);
+	}
+	columns_free(&c);
+
+	return(ierr);
+}
+
+/**
+ * Read the jobs of a project from the tables.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  p         The project.
+ * @param[out] c         The jobs, none if the project has none.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+flat_jobs_read(struct io *io, const struct project *p, struct columns *c)
+{
+	int32_t k    = 0;
+	int32_t ierr = 0;
+	hid_t gid    = 0;
+	const struct flat *f = io->flat;
+
+	c->n = 0;
+	if ((k = flat_find(f, p->name)) < 0) {
+		return(EXIT_SUCCESS);
+	}
+	gid = H5Gopen(io->fid, "jobs", H5P_DEFAULT);
+	ierr = flat_slice(gid, f->joff[k], f->joff[k + 1], c);
+	H5Gclose(gid);
+
+	return(ierr);
+}
+
+/**
+ * Write the utilisation of the reservations of a project.
+ *
+ * The utilisation is written into the project's rows of the usage
+ * datasets, which line up with the reservations table.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  p         The project, already written.
+ * @param[in]  u         The utilisation of each reservation.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+flat_usage_write(struct io *io, const struct project *p,
+		 const struct usage *u)
+{
+	int32_t j    = 0;
+	int32_t k    = 0;
+	int32_t ierr = 0;
+	hid_t gid    = 0;
+	const struct flat *f = io->flat;
+	int64_t *data[3] = {u->used, u->idle, u->jobs};
+
+	if ((k = flat_find(f, p->name)) < 0) {
+		return(EXIT_SUCCESS);
+	}
+	if (u->n != f->roff[k + 1] - f->roff[k]) {
+		warnx("project %s has %" PRId64 " reservations written, not %"
+		      PRId64, p->name, f->roff[k + 1] - f->roff[k], u->n);
+		return(EXIT_FAILURE);
+	}
+	gid = H5Gopen(io->fid, JOIN_GROUP, H5P_DEFAULT);
+	for (j = 0; j < 3; ++j) {
+		ierr |= flat_hyperslab(gid, flat_usage[j], data[j], f->roff[k],
+				       u->n, H5T_NATIVE_INT64, 1);
+	}
+	H5Gclose(gid);
+	io->raw += 3 * u->n * sizeof(int64_t);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Create the type of a name in the project dictionary.
+ *
+ * @return               The type id, to be closed by the caller.
+ **/
+static
+hid_t
+flat_name_type(void)
+{
+	hid_t type_id = 0;
+
+	type_id = H5Tcopy(H5T_C_S1);
+	H5Tset_size(type_id, FLAT_NAME_MAX);
+	H5Tset_strpad(type_id, H5T_STR_NULLTERM);
+
+	return(type_id);
+}
+
+/**
+ * Find a project in the dictionary.
+ *
+ * @param[in]  f         The project dictionary.
+ * @param[in]  name      The project name.
+ *
+ * @return               The index of the project, -1 if it is not there.
+ **/
+static
+int32_t
+flat_find(const struct flat *f, const char *name)
+{
+	int32_t lo  = 0;
+	int32_t hi  = f->n;
+	int32_t mid = 0;
+	int cmp     = 0;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(f->names[mid], name);
+		if (cmp == 0) {
+			return(mid);
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return(-1);
+}
+
+/**
+ * Order the projects of the tables by name.
+ *
+ * @param[in]  a         A struct flat_entry.
+ * @param[in]  b         A struct flat_entry.
+ *
+ * @return               Less than, equal to or greater than zero.
+ **/
+static
+int
+flat_cmp(const void *a, const void *b)
+{
+	return(strcmp(((const struct flat_entry *)a)->name,
+		      ((const struct flat_entry *)b)->name));
+}
+
+/**
+ * Point a set of columns at some of the rows of another.
+ *
+ * @param[in]  c         The columns.
+ * @param[in]  from      The first row.
+ * @param[in]  to        One past the last row.
+ * @param[out] v         The rows, not to be freed.
+ **/
+static
+void
+flat_view(const struct columns *c, int64_t from, int64_t to,
+	  struct columns *v)
+{
+	v->n      = to - from;
+	v->cap    = to - from;
+	v->epochs = c->epochs + from;
+	v->ids    = c->ids    + from;
+	v->nodes  = c->nodes  + from;
+	v->starts = c->starts + from;
+	v->ends   = c->ends   + from;
+}
+
+/**
+ * Read some of the rows of a table.
+ *
+ * @param[in]  id        The group of the table.
+ * @param[in]  from      The first row.
+ * @param[in]  to        One past the last row.
+ * @param[out] c         The rows.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static
+int32_t
+flat_slice(hid_t id, int64_t from, int64_t to, struct columns *c)
+{
+	int32_t ierr = 0;
+	int64_t n    = to - from;
+
+	columns_reserve(c, n);
+	c->n = n;
+	ierr |= flat_hyperslab(id, "epochs", c->epochs, from, n,
+			       H5T_NATIVE_UINT8, 0);
+	ierr |= flat_hyperslab(id, "ids",    c->ids,    from, n,
+			       H5T_NATIVE_INT64, 0);
+	ierr |= flat_hyperslab(id, "nodes",  c->nodes,  from, n,
+			       H5T_NATIVE_INT64, 0);
+	ierr |= flat_hyperslab(id, "starts", c->starts, from, n,
+			       H5T_NATIVE_INT64, 0);
+	ierr |= flat_hyperslab(id, "ends",   c->ends,   from, n,
+			       H5T_NATIVE_INT64, 0);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Read or write a contiguous run of the elements of a 1D dataset.
+ *
+ * @param[in]  id        The id the dataset is under.
+ * @param[in]  name      The name of the dataset.
+ * @param[in,out] data   The elements.
+ * @param[in]  start     The first element.
+ * @param[in]  n         The number of elements.
+ * @param[in]  type      The data type.
+ * @param[in]  write     Write, rather than read, the elements.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static
+int32_t
+flat_hyperslab(hid_t id, const char *name, void *data, int64_t start,
+	       int64_t n, hid_t type, int32_t write)
+{
+	int32_t ierr    = EXIT_SUCCESS;
+	hid_t dset_id   = 0;
+	hid_t fspace_id = 0;
+	hid_t mspace_id = 0;
+	hsize_t offset  = start;
+	hsize_t count   = n;
+	herr_t status   = 0;
+
+	if (n == 0) {
+		return(EXIT_SUCCESS);
+	}
+	if ((dset_id = H5Dopen(id, name, H5P_DEFAULT)) < 0) {
+		return(EXIT_FAILURE);
+	}
+	fspace_id = H5Dget_space(dset_id);
+	mspace_id = H5Screate_simple(1, &count, NULL);
+	H5Sselect_hyperslab(fspace_id, H5S_SELECT_SET, &offset, NULL,
+			    &count, NULL);
+	if (write) {
+		status = H5Dwrite(dset_id, type, mspace_id, fspace_id,
+				  H5P_DEFAULT, data);
+	} else {
+		status = H5Dread(dset_id, type, mspace_id, fspace_id,
+				 H5P_DEFAULT, data);
+	}
+	if (status < 0) {
+		ierr = EXIT_FAILURE;
+	}
+	H5Sclose(mspace_id);
+	H5Sclose(fspace_id);
+	H5Dclose(dset_id);
+
+	return(ierr);
+}
+
+/**
+ * \}
+ **/
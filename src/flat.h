@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file flat.h
+ * Cluster-wide tables of events, sorted by project.
+ *
+ * \ingroup io
+ * \{
+ **/
+
+#ifndef FLAT_H
+#define FLAT_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Name of the dataset of project names, the dictionary **/
+#define FLAT_PROJECTS   "projects"
+
+/** Name of the dataset of each project's first row in a table **/
+#define FLAT_OFFSETS    "offsets"
+
+/** Longest project name the dictionary holds **/
+#define FLAT_NAME_MAX   64
+
+/** The project dictionary and where each project's rows are.
+ * Project i owns rows [off[i], off[i + 1]) of a table, so its slice
+ * of a table is a single hyperslab.
+ **/
+struct flat {
+	int32_t n;                      /* Number of projects */
+	char (*names)[FLAT_NAME_MAX];   /* Project names, sorted */
+	int64_t *joff;                  /* Offsets into the jobs, n + 1 */
+	int64_t *roff;                  /* Offsets into the reservations */
+};
+
+struct io;
+struct project;
+struct columns;
+struct usage;
+
+/** Load the project dictionary of a file **/
+int32_t flat_open(struct io *);
+
+/** Free the project dictionary **/
+void flat_close(struct io *);
+
+/** Write all projects as cluster-wide tables **/
+int32_t flat_write(struct io *, const struct project *);
+
+/** Read the reservations of a project from the tables **/
+int32_t flat_read(struct io *, struct project *);
+
+/** Read the jobs of a project from the tables **/
+int32_t flat_jobs_read(struct io *, const struct project *, struct columns *);
+
+/** Write the utilisation of the reservations of a project **/
+int32_t flat_usage_write(struct io *, const struct project *,
+			 const struct usage *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* FLAT_H */
+/**
+ * \}
+ **/
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file follow.c
+ * Following the event log of the current day.
+ *
+ * The stats directory is watched with inotify, each time the event
+ * log grows its new complete lines are parsed. New events are written
+ * to the output every interval and the log of the next day is picked
+ * up at midnight UTC.
+ *
+ * \ingroup follow
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <hdf5.h>
+
+#include "config.h"
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#include "args.h"
+#include "mem.h"
+#include "events.h"
+#include "projects.h"
+#include "io.h"
+#include "follow.h"
+
+/** Set by a signal to stop following **/
+static volatile sig_atomic_t follow_stop = 0;
+
+static void follow_signal(int);
+static int32_t follow_flush(const struct args *, struct tail *,
+			    struct parser *, struct io *);
+
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Follow the current event log, writing new events as they arrive.
+ *
+ * Runs until interrupted by SIGINT or SIGTERM, when the events parsed
+ * so far are written.
+ *
+ * @param[in]  a         The command line arguments.
+ * @param[in,out] ps     The parser state holding the projects.
+ * @param[in]  io        The open output file.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+follow_run(const struct args *a,
+	   struct parser *ps,
+	   struct io *io)
+{
+	int32_t ierr        = 0;
+	int ifd             = -1;     /* inotify descriptor */
+	int timeout         = 0;      /* Milliseconds to wait */
+	time_t now          = 0;
+	time_t next         = 0;      /* Time of the next write */
+	time_t wake         = 0;
+	char ebuf[4096]     = {0};    /* inotify events, only drained */
+	struct pollfd pfd   = {0};
+	struct sigaction sa = {0};
+	struct tail t       = {0};
+
+	/* Each write would rewrite the whole of the flat tables */
+	if (io->flat) {
+		warnx("--follow can not write the flat layout of %s",
+		      a->output);
+		return(EXIT_FAILURE);
+	}
+
+	if ((ifd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) == -1) {
+		warn("unable to initialise inotify");
+		return(EXIT_FAILURE);
+	}
+	if (inotify_add_watch(ifd, a->stats_dir,
+			      IN_MODIFY | IN_CREATE | IN_MOVED_TO) == -1) {
+		warn("unable to watch %s", a->stats_dir);
+		close(ifd);
+		return(EXIT_FAILURE);
+	}
+
+	/* Interrupt the wait, rather than restart it */
+	sa.sa_handler = follow_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT,  &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	t.fd = -1;
+	now = time(NULL);
+	if ((ierr = follow_open(a->stats_dir, now - now % SECS_IN_DAY, &t,
+				ps->sources))) {
+		goto rtn_err;
+	}
+	next = now + a->interval;
+
+	pfd.fd     = ifd;
+	pfd.events = POLLIN;
+	while (!follow_stop) {
+		if ((ierr = follow_read(&t, 0, ps))) {
+			break;
+		}
+
+		/* Finish the day's log and move on to the next */
+		now = time(NULL);
+		if (now - now % SECS_IN_DAY != t.day) {
+			if ((ierr = follow_read(&t, 1, ps)) ||
+			    (ierr = follow_flush(a, &t, ps, io))) {
+				break;
+			}
+			if ((ierr = follow_open(a->stats_dir,
+						now - now % SECS_IN_DAY, &t,
+						ps->sources))) {
+				break;
+			}
+			next = now + a->interval;
+			continue;
+		}
+
+		if (now >= next) {
+			if ((ierr = follow_flush(a, &t, ps, io))) {
+				break;
+			}
+			next = now + a->interval;
+		}
+
+		/* Wait for the log to grow, or the next write or day */
+		wake = (next < t.day + SECS_IN_DAY) ? next : t.day + SECS_IN_DAY;
+		timeout = (wake > now) ? (wake - now) * 1000 : 0;
+		if (poll(&pfd, 1, timeout) > 0) {
+			while (read(ifd, ebuf, sizeof(ebuf)) > 0) {
+				;
+			}
+		}
+	}
+
+	/* Write whatever has been parsed */
+	if (ierr == 0 && (ierr = follow_read(&t, 0, ps)) == 0) {
+		ierr = follow_flush(a, &t, ps, io);
+	}
+
+rtn_err:
+	follow_close(&t);
+	free(t.buf);
+	close(ifd);
+
+	return(ierr);
+}
+#else
+int32_t
+follow_run(const struct args *a,
+	   struct parser *ps,
+	   struct io *io)
+{
+	warnx("--follow is not supported on this system");
+	return(EXIT_FAILURE);
+}
+#endif
+
+/**
+ * Note that a signal asked for the follow loop to stop.
+ *
+ * @param[in]  sig       The signal.
+ **/
+static void
+follow_signal(int sig ATT_UNUSED)
+{
+	follow_stop = 1;
+}
+
+/**
+ * Start following the event log of a day.
+ *
+ * The log need not exist yet, it is opened once it has been created.
+ * Anything already ingested into the output is skipped.
+ *
+ * @param[in]  dir       The MOAB stats directory.
+ * @param[in]  day       The day (UTC).
+ * @param[in,out] t      The event log being followed.
+ * @param[in]  s         The event logs already ingested.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+follow_open(const char *dir,
+	    time_t day,
+	    struct tail *t,
+	    const struct sources *s)
+{
+	follow_close(t);
+	if (event_name(day, dir, &t->name)) {
+		return(EXIT_FAILURE);
+	}
+	t->day    = day;
+	t->offset = sources_find(s, t->name);
+	t->layout.field = -1;
+	t->layout.off   = 0;
+	printf("Event log: %s (following)\n", t->name);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Parse the lines appended to the event log.
+ *
+ * Only complete lines are parsed, a partial line is left until its
+ * newline is written. When the log is finished with, a final partial
+ * line is parsed as it is.
+ *
+ * @param[in,out] t      The event log being followed.
+ * @param[in]  final     Parse a final line without a newline.
+ * @param[in]  vptr      The parser state passed to the event functions.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+follow_read(struct tail *t,
+	    int32_t final,
+	    void *vptr)
+{
+	ssize_t n   = 0;
+	size_t used = 0;
+
+	if (t->fd == -1) {
+		if ((t->fd = open(t->name, O_RDONLY | O_CLOEXEC)) == -1) {
+			if (errno == ENOENT) {
+				return(EXIT_SUCCESS);
+			}
+			warn("unable to open event log %s", t->name);
+			return(EXIT_FAILURE);
+		}
+	}
+	if (t->buf == NULL) {
+		t->cap = FOLLOW_BUFFER;
+		t->buf = xmalloc(t->cap * sizeof(char));
+	}
+
+	for (;;) {
+		/* Leave room to terminate a final line */
+		n = pread(t->fd, t->buf, t->cap - 1, t->offset);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			warn("unable to read event log %s", t->name);
+			return(EXIT_FAILURE);
+		}
+		if (n == 0) {
+			break;
+		}
+		used = event_lines(t->buf, n, &t->layout, vptr);
+		if (used == 0 && (size_t)n == t->cap - 1) {
+			/* A line longer than the buffer */
+			t->cap *= 2;
+			t->buf = xrealloc(t->buf, t->cap * sizeof(char));
+			continue;
+		}
+		if (used == 0) {
+			if (final) {
+				/* The newline added is not counted as read */
+				t->buf[n] = '\n';
+				event_lines(t->buf, n + 1, &t->layout, vptr);
+				((struct parser *)vptr)->counts.bytes -= 1;
+				t->offset += n;
+			}
+			break;
+		}
+		t->offset += used;
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Write the events parsed so far to the output.
+ *
+ * Jobs are appended to the output, so once written they are dropped
+ * from the columns. Reservations are kept, as a later record may
+ * update them, and are written out in full each time.
+ *
+ * @param[in]  a         The command line arguments.
+ * @param[in]  t         The event log being followed.
+ * @param[in,out] ps     The parser state holding the projects.
+ * @param[in]  io        The open output file.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+follow_flush(const struct args *a,
+	     struct tail *t,
+	     struct parser *ps,
+	     struct io *io)
+{
+	int64_t njobs     = 0;
+	struct project *p = NULL;
+
+	if (t->offset > 0) {
+		sources_set(ps->sources, t->name, t->offset);
+	}
+	if (io_flush(io, ps->projects, ps->sources)) {
+		return(EXIT_FAILURE);
+	}
+	for (p = ps->projects; p != NULL; p = p->next) {
+		njobs += p->jobs.n;
+		p->jobs.n = 0;
+	}
+	if (a->verbose) {
+		printf("Wrote %" PRId64 " jobs, %jd bytes of %s\n", njobs,
+		       (intmax_t)t->offset, t->name);
+		fflush(stdout);
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Stop following an event log.
+ *
+ * @param[in,out] t      The event log being followed.
+ **/
+void
+follow_close(struct tail *t)
+{
+	if (t->fd != -1) {
+		close(t->fd);
+	}
+	t->fd = -1;
+	if (t->name) {
+		free(t->name);
+		t->name = NULL;
+	}
+}
+
+/**
+ * \}
+ **/
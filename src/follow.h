@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file follow.h
+ * Following the event log of the current day.
+ *
+ * \ingroup follow
+ * \{
+ **/
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Bytes read from the event log at a time **/
+#define FOLLOW_BUFFER   (1 << 22)
+
+/** An event log being followed **/
+struct tail {
+	time_t  day;                    /* Day of the event log (UTC) */
+	char    *name;                  /* Event log filename */
+	int     fd;                     /* Open event log, -1 if missing */
+	off_t   offset;                 /* Bytes parsed */
+	struct layout layout;           /* Where the record type is */
+	size_t  cap;                    /* Size of the read buffer */
+	char    *buf;                   /* Read buffer */
+};
+
+struct io;
+
+/** Follow the current event log, writing new events as they arrive **/
+int32_t follow_run(const struct args *, struct parser *, struct io *);
+
+/** Start following the event log of a day **/
+int32_t follow_open(const char *, time_t, struct tail *,
+		    const struct sources *);
+
+/** Parse the lines appended to an event log **/
+int32_t follow_read(struct tail *, int32_t, void *);
+
+/** Stop following an event log **/
+void follow_close(struct tail *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* FOLLOW_H */
+/**
+ * \}
+ **/
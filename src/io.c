@@ -36,6 +36,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
 #include <err.h>
 #include <sysexits.h>
 #include <string.h>
@@ -43,42 +46,81 @@
 
 #include "config.h"
 #include "atts.h"
+#include "args.h"
 #include "mem.h"
 #include "events.h"
 #include "projects.h"
+#include "join.h"
 #include "io.h"
+#include "flat.h"
 
 
+/** A record of the compound layout, as it is held in memory **/
+struct io_row {
+	uint8_t epoch;
+	int64_t id;
+	int64_t nodes;
+	int64_t start;
+	int64_t end;
+};
+
 /** Local static functions **/
-static int io_write_events(hid_t, const struct event *, int64_t);
-static int io_write_data(hid_t, const char *, void *, int64_t, hid_t);
+static int io_filters(struct io *);
+static hid_t io_dcpl(const struct io *, hsize_t);
+static hid_t io_source_type(void);
+static hid_t io_row_type(void);
+static int32_t io_layout(const struct io *, hid_t);
+static int io_write_rows(struct io *, hid_t, const struct columns *, int32_t);
+static int io_read_rows(hid_t, struct columns *);
 
 /**
  * Open a HDF5 file.
  *
  * @param[in]  filename The filename to open.
- * @param[out] id       The file id.
+ * The dataset storage options are taken from the arguments
+ * and checked against the filters this HDF5 library provides.
+ *
+ * @param[in]  filename  The name of the file.
+ * @param[in]  a         The command line arguments.
+ * @param[out] io        The open file.
  *
  * @retval     0         If it was sucessful
  * @retval     1         If there was an error
  **/
 int
-io_open(const char *filename, hid_t *id)
+io_open(const char *filename, const struct args *a, struct io *io)
 {
 	hid_t estack = 0;
+	int32_t created = 1;
 	H5E_auto2_t efunc = {0};
 	void *edata;
 
+	io->fid     = 0;
+	io->chunk   = a->chunk;
+	io->deflate = a->deflate;
+	io->shuffle = a->shuffle;
+	io->filter  = a->filter;
+	io->layout  = a->layout;
+	io->ncd     = a->ncd;
+	memcpy(io->cd, a->cd, sizeof(io->cd));
+	io->raw     = 0;
+	io->stored  = 0;
+	io->flat    = NULL;
+	if (io_filters(io)) {
+		return(EXIT_FAILURE);
+	}
+
 	/* Get the default error handling functions */
 	H5Eget_auto(estack, &efunc, &edata);
 
 	/* Turn off error handling */
 	H5Eset_auto(estack, NULL, NULL);
 
-	*id = H5Fcreate(filename, H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
-	if (*id < 0) {
+	io->fid = H5Fcreate(filename, H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
+	if (io->fid < 0) {
+		created = 0;
 		H5Eclear(estack);
-		if ((*id = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT)) < 0){
+		if ((io->fid = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT)) < 0){
 			H5Eprint(H5E_DEFAULT, stderr);
 			return(EXIT_FAILURE);
 		}
@@ -87,180 +129,921 @@ io_open(const char *filename, hid_t *id)
 	/* Turn on error handling */
 	H5Eset_auto(estack, efunc, edata);
 
+	/* A file with a project dictionary keeps the flat layout */
+	if (H5Lexists(io->fid, FLAT_PROJECTS, H5P_DEFAULT) > 0 ||
+	    (created && io->layout == ARGS_LAYOUT_FLAT)) {
+		return(flat_open(io));
+	}
+
 	return(EXIT_SUCCESS);
 }
 
+/**
+ * Check a file holds the reservations a run is for.
+ *
+ * The ingested event logs are shared by every project in a file, so
+ * a file written for a single reservation, which records its logs as
+ * ingested for that reservation only, can not be mixed with one for
+ * all of them. A new file written for a single reservation is marked
+ * with its name, and after that only runs for the same reservation
+ * may write to it.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  res       The single reservation, NULL for all of them.
+ *
+ * @retval     0         If the run may write to the file
+ * @retval     1         If it may not, or there was an error
+ **/
+int
+io_reservation(struct io *io, const char *res)
+{
+	int32_t ierr   = EXIT_SUCCESS;
+	hid_t aid      = 0;
+	hid_t sid      = 0;
+	hid_t tid      = 0;
+	size_t n       = 0;
+	char *name     = NULL;
+	H5G_info_t info = {0};
+
+	if (H5Aexists(io->fid, IO_RESERVATION) > 0) {
+		aid  = H5Aopen(io->fid, IO_RESERVATION, H5P_DEFAULT);
+		tid  = H5Aget_type(aid);
+		n    = H5Tget_size(tid);
+		name = xmalloc((n + 1) * sizeof(char));
+		memset(name, 0, (n + 1) * sizeof(char));
+		if (H5Aread(aid, tid, name) < 0) {
+			ierr = EXIT_FAILURE;
+		} else if (res == NULL || strcmp(name, res) != 0) {
+			warnx("output holds only reservation %s", name);
+			ierr = EXIT_FAILURE;
+		}
+		free(name);
+		H5Tclose(tid);
+		H5Aclose(aid);
+		return(ierr);
+	}
+	if (res == NULL) {
+		return(EXIT_SUCCESS);
+	}
+
+	H5Gget_info(io->fid, &info);
+	if (info.nlinks > 0) {
+		warnx("output holds all reservations, --reservation %s "
+		      "needs a new file", res);
+		return(EXIT_FAILURE);
+	}
+	tid = H5Tcopy(H5T_C_S1);
+	H5Tset_size(tid, strlen(res) + 1);
+	sid = H5Screate(H5S_SCALAR);
+	aid = H5Acreate(io->fid, IO_RESERVATION, tid, sid, H5P_DEFAULT,
+			H5P_DEFAULT);
+	if (aid < 0 || H5Awrite(aid, tid, res) < 0) {
+		ierr = EXIT_FAILURE;
+	}
+	H5Aclose(aid);
+	H5Sclose(sid);
+	H5Tclose(tid);
+
+	return(ierr);
+}
+
 /**
  * Close a HDF5 file.
  *
- * @param[in] id         The file id.
+ * @param[in] io         The open file.
  *
  * @retval     0         If it was sucessful
  * @retval     1         If there was an error
  **/
 int
-io_close(hid_t id)
+io_close(struct io *io)
+{
+
+	flat_close(io);
+	H5Fclose(io->fid);
+	io->fid = 0;
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Check the requested filters are available for encoding.
+ *
+ * Deflate and shuffle are dropped with a warning when the library
+ * lacks them, any other filter that was asked for by id is an error.
+ *
+ * @param[in,out] io     The open file.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static
+int
+io_filters(struct io *io)
 {
+	uint32_t info = 0;
+
+	if (io->deflate && (!H5Zfilter_avail(H5Z_FILTER_DEFLATE) ||
+	    H5Zget_filter_info(H5Z_FILTER_DEFLATE, &info) < 0 ||
+	    !(info & H5Z_FILTER_CONFIG_ENCODE_ENABLED))) {
+		warnx("deflate filter not available, writing uncompressed");
+		io->deflate = 0;
+	}
+	if (io->shuffle && !H5Zfilter_avail(H5Z_FILTER_SHUFFLE)) {
+		warnx("shuffle filter not available");
+		io->shuffle = 0;
+	}
+	if (io->filter) {
+		if (!H5Zfilter_avail(io->filter) ||
+		    H5Zget_filter_info(io->filter, &info) < 0 ||
+		    !(info & H5Z_FILTER_CONFIG_ENCODE_ENABLED)) {
+			warnx("HDF5 filter %d not available", io->filter);
+			return(EXIT_FAILURE);
+		}
+	}
 
-	H5Fclose(id);
 	return(EXIT_SUCCESS);
 }
 
+/**
+ * Create the dataset creation properties for a dataset.
+ *
+ * Datasets are extendable so they must be chunked. Without a chunk
+ * size one is chosen from the size of the first write, within
+ * [IO_CHUNK_MIN, IO_CHUNK], so small projects do not waste space.
+ *
+ * @param[in] io         The open file.
+ * @param[in] n          The number of elements first written.
+ *
+ * @return               The property list.
+ **/
+static
+hid_t
+io_dcpl(const struct io *io, hsize_t n)
+{
+	hid_t   pid   = 0;
+	hsize_t chunk = io->chunk;
+
+	if (chunk == 0) {
+		chunk = (n < IO_CHUNK_MIN) ? IO_CHUNK_MIN :
+			(n > IO_CHUNK) ? IO_CHUNK : n;
+	}
+
+	pid = H5Pcreate(H5P_DATASET_CREATE);
+	H5Pset_chunk(pid, 1, &chunk);
+	if (io->shuffle) {
+		H5Pset_shuffle(pid);
+	}
+	if (io->deflate) {
+		H5Pset_deflate(pid, io->deflate);
+	}
+	if (io->filter) {
+		H5Pset_filter(pid, io->filter, H5Z_FLAG_OPTIONAL,
+			      io->ncd, io->cd);
+	}
+
+	return(pid);
+}
+
 /**
  * Write a project to a file.
  *
- * @param[in] id         The file id.
+ * The project's groups are created the first time it is written and
+ * reopened after that. Jobs are appended to their datasets, while the
+ * reservations, which io_read() loaded so they could be updated, are
+ * written over the old ones.
+ *
+ * @param[in] io         The open file.
  * @param[in] pjt        The project to write.
  *
  * @retval     0         If it was sucessful
  * @retval     1         If there was an error
  **/
 int
-io_write(hid_t id, const struct project *p)
+io_write(struct io *io, const struct project *p)
 {
 	hid_t   gid = 0;                  /* Group ID */
 	hid_t   eid = 0;                  /* Epoch ID */
 	hid_t   did = 0;                  /* Data ID */
 	hid_t   rid = 0;                  /* Reservation group ID */
 	hid_t   jid = 0;                  /* Job group ID */
-	herr_t  ierr = 0;                 /* Error status */
+	int32_t ierr = 0;                 /* Error status */
 	hsize_t dims = 0;                 /* Tmp dimenstions */
 
 
-	if ((p->nr == 0) && (p->nj == 0)) {
+	if ((p->reservations.n == 0) && (p->jobs.n == 0)) {
 		return(EXIT_SUCCESS);
 	}
 
-	/* Create a group for the reservation project */
-	gid = H5Gcreate(id, p->name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	/* Create or open a group for the reservation project */
+	if ((gid = io_group(io->fid, p->name)) < 0) {
+		return(EXIT_FAILURE);
+	}
 
 	/* Write the project epochs as an attribute */
+	if (H5Aexists(gid, "Epochs") > 0) {
+		H5Adelete(gid, "Epochs");
+	}
 	dims = p->nepochs;
 	did = H5Screate_simple(1, &dims, NULL);
 	eid = H5Acreate(gid, "Epochs", H5T_NATIVE_UINT8,
 			did, H5P_DEFAULT, H5P_DEFAULT);
-	ierr = H5Awrite(eid, H5T_NATIVE_UINT8, &((p->epochs)[0]));
-	ierr = H5Aclose(eid);
+	if (eid < 0 ||
+	    H5Awrite(eid, H5T_NATIVE_UINT8, &((p->epochs)[0])) < 0) {
+		ierr = EXIT_FAILURE;
+	}
+	H5Aclose(eid);
+	H5Sclose(did);
 
 	/* Create a group for reservations */
-	if (p->nr != 0) {
-		rid = H5Gcreate(gid, "reservations", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-		io_write_events(rid, p->reservations, p->nr);
-		ierr = H5Gclose(rid);
+	if (p->reservations.n != 0) {
+		if ((rid = io_group(gid, "reservations")) < 0) {
+			H5Gclose(gid);
+			return(EXIT_FAILURE);
+		}
+		ierr |= io_write_events(io, rid, &p->reservations, 0);
+		H5Gclose(rid);
 	}
 
-	if (p->nj != 0) {
+	if (p->jobs.n != 0) {
 		/* Create a group for jobs */
-		jid = H5Gcreate(gid, "jobs", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-		io_write_events(jid, p->jobs, p->nj);
-		ierr = H5Gclose(jid);
+		if ((jid = io_group(gid, "jobs")) < 0) {
+			H5Gclose(gid);
+			return(EXIT_FAILURE);
+		}
+		ierr |= io_write_events(io, jid, &p->jobs, 1);
+		H5Gclose(jid);
 	}
 
-	ierr = H5Gclose(gid);
+	H5Gclose(gid);
+	if (ierr) {
+		warnx("unable to write project %s", p->name);
+	}
 
-	return(EXIT_SUCCESS);
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Write all projects and the ingested event logs, then flush the file.
+ *
+ * The logs are only recorded as ingested once every project has been
+ * written, so a failed write is read again by the next run.
+ *
+ * @param[in] io         The open file.
+ * @param[in] p          The list of projects to write.
+ * @param[in] s          The ingested event logs.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_flush(struct io *io, const struct project *p, const struct sources *s)
+{
+	int32_t ierr = 0;
+
+	if (io->flat) {
+		ierr |= flat_write(io, p);
+	} else {
+		while (p != NULL) {
+			ierr |= io_write(io, p);
+			p = p->next;
+		}
+	}
+	if (ierr == 0) {
+		ierr |= io_sources_write(io, s);
+	}
+	if (H5Fflush(io->fid, H5F_SCOPE_GLOBAL) < 0) {
+		ierr = EXIT_FAILURE;
+	}
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Write the events of a batch of merged event logs.
+ *
+ * This is handed to the parser as its flush, so each event log of a
+ * range is written by the range's writer thread while the later ones
+ * are still being parsed. The batch holds the jobs of the logs, which
+ * are appended to the output, and all the reservations, as a later
+ * log may have updated them. The flat tables are rewritten in full, so
+ * are only written once and are not given a flush.
+ *
+ * @param[in]  ps        The batch.
+ * @param[in]  vptr      The open file.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+io_drain(struct parser *ps, void *vptr)
+{
+	struct io *io = (struct io *)vptr;
+
+	return(io_flush(io, ps->projects, ps->sources));
+}
+
+/**
+ * Open a group, creating it if it does not exist.
+ *
+ * @param[in]  id        The id to open the group under.
+ * @param[in]  name      The name of the group.
+ *
+ * @return               The group id, negative if there was an error.
+ **/
+hid_t
+io_group(hid_t id, const char *name)
+{
+	if (H5Lexists(id, name, H5P_DEFAULT) > 0) {
+		return(H5Gopen(id, name, H5P_DEFAULT));
+	}
+	return(H5Gcreate(id, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+}
+
+/**
+ * Find how a group of events is laid out.
+ *
+ * A group that already holds events keeps the layout it was written
+ * with, so appends match, a new group takes the requested layout.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  id        The id of the group.
+ *
+ * @return               The layout of the group.
+ **/
+static
+int32_t
+io_layout(const struct io *io, hid_t id)
+{
+	if (H5Lexists(id, IO_EVENTS, H5P_DEFAULT) > 0) {
+		return(ARGS_LAYOUT_COMPOUND);
+	}
+	if (H5Lexists(id, "ends", H5P_DEFAULT) > 0) {
+		return(ARGS_LAYOUT_COLUMNS);
+	}
+	return(io->layout);
+}
+
+/**
+ * Write a set of event columns.
+ *
+ * Each column is written straight from its buffer, unless the group
+ * has the compound layout.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  id        The id of the group to write under.
+ * @param[in]  c         The event columns to write.
+ * @param[in]  append    Append to, rather than replace, existing data.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_write_events(struct io *io, hid_t id, const struct columns *c,
+		int32_t append)
+{
+	int32_t ierr = 0;
+
+	if (io_layout(io, id) == ARGS_LAYOUT_COMPOUND) {
+		return(io_write_rows(io, id, c, append));
+	}
+
+	ierr |= io_write_data(io, id, "epochs", c->epochs, c->n,
+			      H5T_NATIVE_UINT8, append);
+	ierr |= io_write_data(io, id, "ids",    c->ids,    c->n,
+			      H5T_NATIVE_INT64, append);
+	ierr |= io_write_data(io, id, "nodes",  c->nodes,  c->n,
+			      H5T_NATIVE_INT64, append);
+	ierr |= io_write_data(io, id, "starts", c->starts, c->n,
+			      H5T_NATIVE_INT64, append);
+	ierr |= io_write_data(io, id, "ends",   c->ends,   c->n,
+			      H5T_NATIVE_INT64, append);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
 /**
- * Write an event linked-list.
+ * Write a set of event columns as a single dataset of records.
  *
- * Note, this changes a linked-list of structs to arrays.
+ * The columns are gathered into records, which are written with one
+ * call rather than one for each field.
  *
+ * @param[in]  io        The open file.
  * @param[in]  id        The id of the group to write under.
- * @param[in]  e         The event linked list to write.
- * @param[in]  n         The number of events in the linked list.
+ * @param[in]  c         The event columns to write.
+ * @param[in]  append    Append to, rather than replace, existing data.
  *
  * @retval     0         If it was sucessful
  * @retval     1         If there was an error
  **/
 static
 int
-io_write_events(hid_t id, const struct event *e, int64_t n)
+io_write_rows(struct io *io, hid_t id, const struct columns *c,
+	      int32_t append)
 {
-	int64_t i = 0;
-	struct event *eptr = NULL;
-	uint8_t *edata  = NULL;
-	int64_t *ids    = NULL;
-	int64_t *nodes  = NULL;
-	int64_t *starts = NULL;
-	int64_t *ends   = NULL;
-
-	edata  = xmemalign(n*sizeof(uint8_t));
-	ids    = xmemalign(n*sizeof(int64_t));
-	nodes  = xmemalign(n*sizeof(int64_t));
-	starts = xmemalign(n*sizeof(int64_t));
-	ends   = xmemalign(n*sizeof(int64_t));
-
-	eptr = (struct event *)e;
-	i = n-1;
-	while (eptr != NULL) {
-		edata[i]  = eptr->epoch;
-		ids[i]    = eptr->id;
-		nodes[i]  = eptr->nodes;
-		starts[i] = eptr->start;
-		ends[i]   = eptr->end;
-		eptr = eptr->next;
-		--i;
-	}
-
-	/* write the data */
-	io_write_data(id, "epochs", edata,  n, H5T_NATIVE_UINT8);
-	io_write_data(id, "ids",    ids,    n, H5T_NATIVE_INT64);
-	io_write_data(id, "nodes",  nodes,  n, H5T_NATIVE_INT64);
-	io_write_data(id, "starts", starts, n, H5T_NATIVE_INT64);
-	io_write_data(id, "ends",   ends,   n, H5T_NATIVE_INT64);
-
-	free(edata);
-	free(ids);
-	free(nodes);
-	free(starts);
-	free(ends);
+	int64_t i       = 0;
+	int32_t ierr    = 0;
+	hid_t type_id   = 0;
+	struct io_row *rows = NULL;
 
-	return(EXIT_SUCCESS);
+	rows = xmalloc((c->n + 1) * sizeof(struct io_row));
+	for (i = 0; i < c->n; ++i) {
+		rows[i].epoch = c->epochs[i];
+		rows[i].id    = c->ids[i];
+		rows[i].nodes = c->nodes[i];
+		rows[i].start = c->starts[i];
+		rows[i].end   = c->ends[i];
+	}
+	type_id = io_row_type();
+	ierr = io_write_data(io, id, IO_EVENTS, rows, c->n, type_id, append);
+	H5Tclose(type_id);
+	free(rows);
+
+	return(ierr);
+}
+
+/**
+ * Read the reservations of a project already in a file.
+ *
+ * The reservations are added to the project as if they had been
+ * parsed, so later records can update them.
+ *
+ * @param[in]  io        The open file.
+ * @param[in,out] p      The project.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_read(struct io *io, struct project *p)
+{
+	int64_t i         = 0;
+	int32_t ierr      = 0;
+	hid_t   gid       = 0;
+	struct event e    = {0};
+	struct columns c  = {0};
+
+	if (io->flat) {
+		return(flat_read(io, p));
+	}
+	if (H5Lexists(io->fid, p->name, H5P_DEFAULT) <= 0) {
+		return(EXIT_SUCCESS);
+	}
+	gid = H5Gopen(io->fid, p->name, H5P_DEFAULT);
+	if (H5Lexists(gid, "reservations", H5P_DEFAULT) > 0) {
+		ierr = io_read_events(H5Gopen(gid, "reservations", H5P_DEFAULT),
+				      &c);
+		for (i = 0; i < c.n; ++i) {
+			columns_get(&c, i, &e);
+			project_add_rsv(p, &e);
+		}
+		columns_free(&c);
+	}
+	H5Gclose(gid);
+
+	return(ierr);
+}
+
+/**
+ * Read all the jobs of a project in a file.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  p         The project.
+ * @param[out] c         The jobs, none if the project has none.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_jobs_read(struct io *io, const struct project *p, struct columns *c)
+{
+	int32_t ierr      = 0;
+	hid_t   gid       = 0;
+
+	if (io->flat) {
+		return(flat_jobs_read(io, p, c));
+	}
+	c->n = 0;
+	if (H5Lexists(io->fid, p->name, H5P_DEFAULT) <= 0) {
+		return(EXIT_SUCCESS);
+	}
+	gid = H5Gopen(io->fid, p->name, H5P_DEFAULT);
+	if (H5Lexists(gid, "jobs", H5P_DEFAULT) > 0) {
+		ierr = io_read_events(H5Gopen(gid, "jobs", H5P_DEFAULT), c);
+	}
+	H5Gclose(gid);
+
+	return(ierr);
+}
+
+/**
+ * Write the utilisation of the reservations of a project.
+ *
+ * The datasets sit in their own group next to the reservations and,
+ * like them, are written over each time.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  p         The project, already written.
+ * @param[in]  u         The utilisation of each reservation.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_usage_write(struct io *io, const struct project *p, const struct usage *u)
+{
+	int32_t ierr = 0;
+	hid_t   gid  = 0;
+	hid_t   uid  = 0;
+
+	if (io->flat) {
+		return(flat_usage_write(io, p, u));
+	}
+	if (H5Lexists(io->fid, p->name, H5P_DEFAULT) <= 0) {
+		return(EXIT_SUCCESS);
+	}
+	gid = H5Gopen(io->fid, p->name, H5P_DEFAULT);
+	if ((uid = io_group(gid, JOIN_GROUP)) < 0) {
+		H5Gclose(gid);
+		return(EXIT_FAILURE);
+	}
+	ierr |= io_write_data(io, uid, "used", u->used, u->n,
+			      H5T_NATIVE_INT64, 0);
+	ierr |= io_write_data(io, uid, "idle", u->idle, u->n,
+			      H5T_NATIVE_INT64, 0);
+	ierr |= io_write_data(io, uid, "jobs", u->jobs, u->n,
+			      H5T_NATIVE_INT64, 0);
+	H5Gclose(uid);
+	H5Gclose(gid);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Read a set of event columns.
+ *
+ * @param[in]  id        The group to read from, closed on return.
+ * @param[out] c         The event columns.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_read_events(hid_t id, struct columns *c)
+{
+	int32_t ierr  = 0;
+	hid_t did     = 0;
+	hid_t sid     = 0;
+	hsize_t dims  = 0;
+
+	if (H5Lexists(id, IO_EVENTS, H5P_DEFAULT) > 0) {
+		return(io_read_rows(id, c));
+	}
+
+	did = H5Dopen(id, "ends", H5P_DEFAULT);
+	sid = H5Dget_space(did);
+	H5Sget_simple_extent_dims(sid, &dims, NULL);
+	H5Sclose(sid);
+	H5Dclose(did);
+
+	columns_reserve(c, dims);
+	c->n = dims;
+	ierr |= io_read_data(id, "epochs", c->epochs, c->n, H5T_NATIVE_UINT8);
+	ierr |= io_read_data(id, "ids",    c->ids,    c->n, H5T_NATIVE_INT64);
+	ierr |= io_read_data(id, "nodes",  c->nodes,  c->n, H5T_NATIVE_INT64);
+	ierr |= io_read_data(id, "starts", c->starts, c->n, H5T_NATIVE_INT64);
+	ierr |= io_read_data(id, "ends",   c->ends,   c->n, H5T_NATIVE_INT64);
+	H5Gclose(id);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Read a set of event columns from a single dataset of records.
+ *
+ * @param[in]  id        The group to read from, closed on return.
+ * @param[out] c         The event columns.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static
+int
+io_read_rows(hid_t id, struct columns *c)
+{
+	int64_t i     = 0;
+	int32_t ierr  = 0;
+	hid_t did     = 0;
+	hid_t sid     = 0;
+	hid_t type_id = 0;
+	hsize_t dims  = 0;
+	struct io_row *rows = NULL;
+
+	did = H5Dopen(id, IO_EVENTS, H5P_DEFAULT);
+	sid = H5Dget_space(did);
+	H5Sget_simple_extent_dims(sid, &dims, NULL);
+	H5Sclose(sid);
+	H5Dclose(did);
+
+	rows = xmalloc((dims + 1) * sizeof(struct io_row));
+	type_id = io_row_type();
+	ierr = io_read_data(id, IO_EVENTS, rows, dims, type_id);
+	H5Tclose(type_id);
+	H5Gclose(id);
+
+	columns_reserve(c, dims);
+	c->n = dims;
+	for (i = 0; i < c->n; ++i) {
+		c->epochs[i] = rows[i].epoch;
+		c->ids[i]    = rows[i].id;
+		c->nodes[i]  = rows[i].nodes;
+		c->starts[i] = rows[i].start;
+		c->ends[i]   = rows[i].end;
+	}
+	free(rows);
+
+	return(ierr);
+}
+
+/**
+ * Read a 1D data array from the HDF5 file.
+ *
+ * @param[in]  id        The id to read the data from.
+ * @param[in]  name      The name of the dataset.
+ * @param[out] data      The data read.
+ * @param[in]  n         The number of elements to read.
+ * @param[in]  type      The data type.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_read_data(hid_t id, const char *name, void * restrict data, int64_t n,
+	     hid_t type)
+{
+	int32_t ierr    = EXIT_SUCCESS;
+	hid_t dset_id   = 0;
+	hid_t fspace_id = 0;
+	hid_t mspace_id = 0;
+	hsize_t dims    = 0;
+
+	if ((dset_id = H5Dopen(id, name, H5P_DEFAULT)) < 0) {
+		return(EXIT_FAILURE);
+	}
+	fspace_id = H5Dget_space(dset_id);
+	H5Sget_simple_extent_dims(fspace_id, &dims, NULL);
+	if (dims != (hsize_t)n) {
+		warnx("dataset %s has %llu elements, expected %" PRId64,
+		      name, (unsigned long long)dims, n);
+		ierr = EXIT_FAILURE;
+	} else if (n > 0) {
+		mspace_id = H5Screate_simple(1, &dims, NULL);
+		if (H5Dread(dset_id, type, mspace_id, fspace_id,
+			    H5P_DEFAULT, data) < 0) {
+			ierr = EXIT_FAILURE;
+		}
+		H5Sclose(mspace_id);
+	}
+	H5Sclose(fspace_id);
+	H5Dclose(dset_id);
+
+	return(ierr);
 }
 
 
 /**
  * Write a 1D data array to the HDF5 file.
  *
+ * A new dataset is created with an unlimited maximum size. If the
+ * dataset already exists it is either extended and the data written
+ * to the new elements with a hyperslab, or resized and written over.
+ *
+ * @param[in]  io        The open file.
  * @param[in]  id        The id to write the data under.
  * @param[in]  name      The name of the dataset.
  * @param[in]  data      The data to write.
  * @param[in]  n         The number of elements in the data array.
  * @param[in]  type      The data type.
+ * @param[in]  append    Append to, rather than replace, existing data.
  *
  * @retval     0         If it was sucessful
  * @retval     1         If there was an error
  **/
-static
 int
-io_write_data(hid_t id, const char *name, void * restrict data, int64_t n, hid_t type)
+io_write_data(struct io *io, hid_t id, const char *name,
+	      void * restrict data, int64_t n, hid_t type, int32_t append)
 {
-	hid_t dspace_id = 0;
+	int32_t ierr    = EXIT_SUCCESS;
+	hid_t fspace_id = 0;
+	hid_t mspace_id = 0;
 	hid_t dtype_id  = 0;
 	hid_t dset_id   = 0;
+	hid_t dcpl_id   = 0;
 	hsize_t dims    = 0;
-	int32_t bsize   = 0;
+	hsize_t maxdims = H5S_UNLIMITED;
+	hsize_t start   = 0;
+	hsize_t count   = 0;
+	hsize_t stored  = 0;
+
+	count = n;
+	mspace_id = H5Screate_simple(1, &count, NULL);
+
+	if (H5Lexists(id, name, H5P_DEFAULT) > 0) {
+		/* Extend the existing dataset */
+		dset_id = H5Dopen(id, name, H5P_DEFAULT);
+		fspace_id = H5Dget_space(dset_id);
+		H5Sget_simple_extent_dims(fspace_id, &start, &maxdims);
+		H5Sclose(fspace_id);
+		if (maxdims != H5S_UNLIMITED) {
+			warnx("dataset %s can not be extended", name);
+			ierr = EXIT_FAILURE;
+			goto rtn_err;
+		}
+		stored = H5Dget_storage_size(dset_id);
+		if (!append) {
+			start = 0;
+		}
+		dims = start + count;
+		H5Dset_extent(dset_id, &dims);
+	} else {
+		/* Create the data set, chunked and filtered if asked */
+		dims = count;
+		fspace_id = H5Screate_simple(1, &dims, &maxdims);
+		/* Records are stored without the padding they have in memory */
+		dtype_id = H5Tcopy(type);
+		if (H5Tget_class(dtype_id) == H5T_COMPOUND) {
+			H5Tpack(dtype_id);
+		}
+		dcpl_id = io_dcpl(io, dims);
+		dset_id = H5Dcreate(id, name, dtype_id, fspace_id,
+				    H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+		H5Pclose(dcpl_id);
+		H5Tclose(dtype_id);
+		H5Sclose(fspace_id);
+	}
+
+	/* Write the data to the new elements */
+	fspace_id = H5Dget_space(dset_id);
+	H5Sselect_hyperslab(fspace_id, H5S_SELECT_SET, &start, NULL,
+			    &count, NULL);
+	if (H5Dwrite(dset_id, type, mspace_id, fspace_id,
+		     H5P_DEFAULT, data) < 0) {
+		ierr = EXIT_FAILURE;
+	}
+	H5Sclose(fspace_id);
+	dtype_id = H5Dget_type(dset_id);
+	io->raw    += count * H5Tget_size(dtype_id);
+	io->stored += H5Dget_storage_size(dset_id) - stored;
+	H5Tclose(dtype_id);
 
-	dims = n;
-	/* Create the dataspace */
-	dspace_id = H5Screate_simple(1, &dims, NULL);
+rtn_err:
+	H5Dclose(dset_id);
+	H5Sclose(mspace_id);
 
-	/* Set the data type */
-	dtype_id = H5Tcopy(type);
+	return(ierr);
+}
 
-	/* Create the data set */
-	dset_id = H5Dcreate(id, name, dtype_id, dspace_id,
-			    H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+/**
+ * Read the event logs already ingested into a file.
+ *
+ * @param[in]  io        The open file.
+ * @param[out] s         The ingested event logs.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_sources_read(struct io *io, struct sources *s)
+{
+	hid_t   dset_id = 0;
+	hid_t   space_id = 0;
+	hid_t   type_id = 0;
+	hsize_t dims    = 0;
+	int32_t ierr    = EXIT_SUCCESS;
 
-	/* Write the data */
-	H5Dwrite(dset_id, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
+	memset(s, 0, sizeof(struct sources));
+	if (H5Lexists(io->fid, IO_SOURCES, H5P_DEFAULT) <= 0) {
+		return(EXIT_SUCCESS);
+	}
 
+	dset_id = H5Dopen(io->fid, IO_SOURCES, H5P_DEFAULT);
+	space_id = H5Dget_space(dset_id);
+	H5Sget_simple_extent_dims(space_id, &dims, NULL);
+	if (dims > 0) {
+		s->n = s->cap = dims;
+		s->s = xmalloc(dims * sizeof(struct source));
+		type_id = io_source_type();
+		if (H5Dread(dset_id, type_id, H5S_ALL, H5S_ALL,
+			    H5P_DEFAULT, s->s) < 0) {
+			ierr = EXIT_FAILURE;
+		}
+		H5Tclose(type_id);
+	}
+	H5Sclose(space_id);
 	H5Dclose(dset_id);
-	H5Tclose(dtype_id);
-	H5Sclose(dspace_id);
 
-	return(EXIT_SUCCESS);
+	return(ierr);
+}
+
+/**
+ * Record the event logs ingested into a file.
+ *
+ * The whole list is written over the previous one, entries only ever
+ * grow or are added so the dataset is extended to fit.
+ *
+ * @param[in]  io        The open file.
+ * @param[in]  s         The ingested event logs.
+ *
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int
+io_sources_write(struct io *io, const struct sources *s)
+{
+	hid_t   dset_id  = 0;
+	hid_t   space_id = 0;
+	hid_t   type_id  = 0;
+	hid_t   dcpl_id  = 0;
+	hsize_t dims     = s->n;
+	hsize_t maxdims  = H5S_UNLIMITED;
+	hsize_t chunk    = 64;
+	int32_t ierr     = EXIT_SUCCESS;
+
+	if (s->n == 0) {
+		return(EXIT_SUCCESS);
+	}
+
+	type_id = io_source_type();
+	if (H5Lexists(io->fid, IO_SOURCES, H5P_DEFAULT) > 0) {
+		dset_id = H5Dopen(io->fid, IO_SOURCES, H5P_DEFAULT);
+		H5Dset_extent(dset_id, &dims);
+	} else {
+		space_id = H5Screate_simple(1, &dims, &maxdims);
+		dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+		H5Pset_chunk(dcpl_id, 1, &chunk);
+		dset_id = H5Dcreate(io->fid, IO_SOURCES, type_id, space_id,
+				    H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+		H5Pclose(dcpl_id);
+		H5Sclose(space_id);
+	}
+	if (H5Dwrite(dset_id, type_id, H5S_ALL, H5S_ALL,
+		     H5P_DEFAULT, s->s) < 0) {
+		ierr = EXIT_FAILURE;
+	}
+	H5Dclose(dset_id);
+	H5Tclose(type_id);
+
+	return(ierr);
+}
+
+/**
+ * Create the compound type of an ingested event log.
+ *
+ * @return               The type id, to be closed by the caller.
+ **/
+static
+hid_t
+io_source_type(void)
+{
+	hid_t str_id  = 0;
+	hid_t type_id = 0;
+
+	str_id = H5Tcopy(H5T_C_S1);
+	H5Tset_size(str_id, SOURCE_NAME_MAX);
+	H5Tset_strpad(str_id, H5T_STR_NULLTERM);
+
+	type_id = H5Tcreate(H5T_COMPOUND, sizeof(struct source));
+	H5Tinsert(type_id, "name", HOFFSET(struct source, name), str_id);
+	H5Tinsert(type_id, "size", HOFFSET(struct source, size),
+		  H5T_NATIVE_INT64);
+	H5Tclose(str_id);
+
+	return(type_id);
+}
+
+/**
+ * Create the compound type of a record of the compound layout.
+ *
+ * @return               The type id, to be closed by the caller.
+ **/
+static
+hid_t
+io_row_type(void)
+{
+	hid_t type_id = 0;
+
+	type_id = H5Tcreate(H5T_COMPOUND, sizeof(struct io_row));
+	H5Tinsert(type_id, "epoch", HOFFSET(struct io_row, epoch),
+		  H5T_NATIVE_UINT8);
+	H5Tinsert(type_id, "id",    HOFFSET(struct io_row, id),
+		  H5T_NATIVE_INT64);
+	H5Tinsert(type_id, "nodes", HOFFSET(struct io_row, nodes),
+		  H5T_NATIVE_INT64);
+	H5Tinsert(type_id, "start", HOFFSET(struct io_row, start),
+		  H5T_NATIVE_INT64);
+	H5Tinsert(type_id, "end",   HOFFSET(struct io_row, end),
+		  H5T_NATIVE_INT64);
+
+	return(type_id);
 }
 
 /**
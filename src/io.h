@@ -42,14 +42,88 @@ extern "C"
 {
 #endif
 
+/** Largest chunk size chosen when none is given **/
+#define IO_CHUNK                4096
+
+/** Smallest chunk size chosen when none is given **/
+#define IO_CHUNK_MIN            256
+
+/** Name of the dataset of records in the compound layout **/
+#define IO_EVENTS               "events"
+
+/** Name of the attribute naming the single reservation of a file **/
+#define IO_RESERVATION          "Reservation"
+
+/** Name of the dataset listing the ingested event logs **/
+#define IO_SOURCES              "sources"
+
+/** An open output file and how its datasets are stored **/
+struct io {
+	hid_t    fid;                   /**< The file id **/
+	hsize_t  chunk;                 /**< Chunk size, 0 to choose one **/
+	uint32_t deflate;               /**< Deflate level, 0 for none **/
+	int32_t  shuffle;               /**< Apply the shuffle filter **/
+	int32_t  filter;                /**< Another filter id, 0 for none **/
+	int32_t  layout;                /**< Layout of new event groups **/
+	size_t   ncd;                   /**< Number of filter client values **/
+	uint32_t cd[ARGS_MAX_CD];       /**< Filter client values **/
+	uint64_t raw;                   /**< Bytes of data written **/
+	uint64_t stored;                /**< Bytes of storage allocated **/
+	struct flat *flat;              /**< Cluster-wide tables, or NULL **/
+};
+
+struct usage;
+struct parser;
+struct flat;
+
 /** Open/Append to a file **/
-int io_open(const char *, hid_t *);
+int io_open(const char *, const struct args *, struct io *);
+
+/** Check a file holds the reservations a run is for **/
+int io_reservation(struct io *, const char *);
 
 /** Close a file **/
-int io_close(hid_t);
+int io_close(struct io *);
 
 /** Write a reservation **/
-int io_write(hid_t, const struct project *);
+int io_write(struct io *, const struct project *);
+
+/** Write all projects and the ingested event logs, then flush **/
+int io_flush(struct io *, const struct project *, const struct sources *);
+
+/** Write the events of a batch of merged event logs **/
+int32_t io_drain(struct parser *, void *);
+
+/** Read the reservations of a project already in a file **/
+int io_read(struct io *, struct project *);
+
+/** Read all the jobs of a project in a file **/
+int io_jobs_read(struct io *, const struct project *, struct columns *);
+
+/** Write the utilisation of the reservations of a project **/
+int io_usage_write(struct io *, const struct project *, const struct usage *);
+
+/** Read the event logs already ingested into a file **/
+int io_sources_read(struct io *, struct sources *);
+
+/** Record the event logs ingested into a file **/
+int io_sources_write(struct io *, const struct sources *);
+
+/** Open a group, creating it if it does not exist **/
+hid_t io_group(hid_t, const char *);
+
+/** Write a set of event columns **/
+int io_write_events(struct io *, hid_t, const struct columns *, int32_t);
+
+/** Write a 1D data array **/
+int io_write_data(struct io *, hid_t, const char *, void *, int64_t, hid_t,
+		  int32_t);
+
+/** Read a set of event columns **/
+int io_read_events(hid_t, struct columns *);
+
+/** Read a 1D data array **/
+int io_read_data(hid_t, const char *, void *, int64_t, hid_t);
 
 #ifdef __cplusplus
 }                               /* extern "C" */
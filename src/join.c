@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file join.c
+ * Joining jobs to the reservation instances they ran in.
+ *
+ * A reservation is recreated for each day it runs, all instances
+ * sharing an epoch. A job names the reservation and epoch it asked
+ * for, so it ran in whichever instances of that epoch it overlapped
+ * in time. Sorting both the reservations and the jobs by
+ * (epoch, start) lets every job be matched in a single merge pass,
+ * rather than comparing each reservation with every job.
+ *
+ * \ingroup join
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <hdf5.h>
+
+#include "config.h"
+#include "args.h"
+#include "mem.h"
+#include "events.h"
+#include "projects.h"
+#include "join.h"
+#include "io.h"
+
+/** Sort key of a reservation or job **/
+struct join_key {
+	int64_t start;                  /* Start time */
+	int64_t row;                    /* Row in its columns */
+	uint8_t epoch;                  /* Epoch */
+};
+
+/**
+ * Compare two sort keys by epoch, then by start time.
+ *
+ * Equal keys are ordered by row so the sort is stable. The rows of
+ * reservations and jobs are unrelated, so only the sort uses them.
+ **/
+static int
+join_cmp(const void *a,
+	 const void *b)
+{
+	const struct join_key *x = a;
+	const struct join_key *y = b;
+
+	if (x->epoch != y->epoch) {
+		return((x->epoch > y->epoch) - (x->epoch < y->epoch));
+	}
+	if (x->start != y->start) {
+		return((x->start > y->start) - (x->start < y->start));
+	}
+	return((x->row > y->row) - (x->row < y->row));
+}
+
+/**
+ * Sort a set of columns by epoch, then by start time.
+ *
+ * \param[in] c      The columns.
+ * \return           The sort keys, to be free()'ed.
+ **/
+static struct join_key *
+join_sort(const struct columns *c)
+{
+	int64_t i          = 0;
+	struct join_key *k = NULL;
+
+	k = xmalloc((c->n ? c->n : 1) * sizeof(struct join_key));
+	for (i = 0; i < c->n; ++i) {
+		k[i].start = c->starts[i];
+		k[i].row   = i;
+		k[i].epoch = c->epochs[i];
+	}
+	qsort(k, c->n, sizeof(struct join_key), join_cmp);
+
+	return(k);
+}
+
+/**
+ * Join jobs to the reservation instances they ran in.
+ *
+ * Each job is given to every instance of its epoch it overlaps in
+ * time, with the node seconds it used clipped to each instance. A
+ * job of no length counts in the instance it started in. Jobs of an
+ * epoch with no such instance are left out.
+ *
+ * Jobs are taken in order of start, so an instance that ended before
+ * one job started is passed over for all later jobs. Each job then
+ * scans only from the first instance still running up to the last
+ * to start before the job ended, which is O(n log n) in the number
+ * of events when instances of an epoch do not nest.
+ *
+ * \param[in] rsv    The reservations.
+ * \param[in] jobs   The jobs.
+ * \param[out] u     The utilisation of each reservation, to be freed
+ *                   with join_free().
+ * \retval 0         If the jobs were joined.
+ **/
+int32_t
+join_usage(const struct columns *rsv,
+	   const struct columns *jobs,
+	   struct usage *u)
+{
+	int64_t i          = 0;
+	int64_t j          = 0;
+	int64_t k          = 0;
+	int64_t row        = 0;
+	int64_t js         = 0;             /* Start of the job */
+	int64_t je         = 0;             /* End of the job */
+	int64_t last       = 0;             /* Instances must start before */
+	int64_t start      = 0;
+	int64_t end        = 0;
+	int64_t total      = 0;
+	size_t size        = 0;
+	struct join_key *rk = NULL;
+	struct join_key *jk = NULL;
+
+	u->n    = rsv->n;
+	size    = (rsv->n ? rsv->n : 1) * sizeof(int64_t);
+	u->used = xmalloc(size);
+	u->idle = xmalloc(size);
+	u->jobs = xmalloc(size);
+	memset(u->used, 0, size);
+	memset(u->jobs, 0, size);
+
+	rk = join_sort(rsv);
+	jk = join_sort(jobs);
+
+	for (j = 0; j < jobs->n; ++j) {
+		js   = jk[j].start;
+		je   = jobs->ends[jk[j].row];
+		last = (je > js) ? je : js + 1;
+		/* Pass over earlier epochs and instances that have ended */
+		while (i < rsv->n && (rk[i].epoch < jk[j].epoch ||
+		       (rk[i].epoch == jk[j].epoch &&
+			rsv->ends[rk[i].row] <= js))) {
+			++i;
+		}
+		for (k = i; k < rsv->n && rk[k].epoch == jk[j].epoch &&
+			     rk[k].start < last; ++k) {
+			row = rk[k].row;
+			if (rsv->ends[row] <= js) {
+				continue;
+			}
+			start = (js > rk[k].start) ? js : rk[k].start;
+			end   = (je < rsv->ends[row]) ? je : rsv->ends[row];
+			if (end > start) {
+				u->used[row] += jobs->nodes[jk[j].row] *
+					(end - start);
+			}
+			u->jobs[row] += 1;
+		}
+	}
+
+	for (i = 0; i < rsv->n; ++i) {
+		total = rsv->nodes[i] * (rsv->ends[i] - rsv->starts[i]);
+		u->idle[i] = (total > u->used[i]) ? total - u->used[i] : 0;
+	}
+
+	free(rk);
+	free(jk);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Write the utilisation of the reservations of a list of projects.
+ *
+ * The jobs are read back from the output, as earlier runs appended
+ * jobs that are no longer held, and joined with the reservations.
+ *
+ * \param[in] io     The open output file, already flushed.
+ * \param[in] p      The first project in the list.
+ * \retval 0         If the utilisation was written.
+ * \retval 1         If there was an error.
+ **/
+int32_t
+join_projects(struct io *io,
+	      const struct project *p)
+{
+	int32_t ierr       = 0;
+	struct columns c   = {0};
+	struct usage u     = {0};
+
+	for (; p != NULL; p = p->next) {
+		if (p->reservations.n == 0) {
+			continue;
+		}
+		if (io_jobs_read(io, p, &c)) {
+			ierr = EXIT_FAILURE;
+			continue;
+		}
+		join_usage(&p->reservations, &c, &u);
+		ierr |= io_usage_write(io, p, &u);
+		join_free(&u);
+		c.n = 0;
+	}
+	columns_free(&c);
+
+	return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Free the utilisation of a project.
+ *
+ * \param[in,out] u  The utilisation.
+ **/
+void
+join_free(struct usage *u)
+{
+	if (u->used) {
+		free(u->used);
+	}
+	if (u->idle) {
+		free(u->idle);
+	}
+	if (u->jobs) {
+		free(u->jobs);
+	}
+	memset(u, 0, sizeof(struct usage));
+}
+
+/**
+ * \}
+ **/
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file join.h
+ * Joining jobs to the reservation instances they ran in.
+ *
+ * \ingroup join
+ * \{
+ **/
+
+#ifndef JOIN_H
+#define JOIN_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Name of the group holding the utilisation of each reservation **/
+#define JOIN_GROUP      "usage"
+
+/** Utilisation of each reservation instance of a project.
+ * Row i describes row i of the project's reservations.
+ **/
+struct usage {
+	int64_t n;                      /* Number of reservations */
+	int64_t *used;                  /* Node seconds used by jobs */
+	int64_t *idle;                  /* Node seconds left idle */
+	int64_t *jobs;                  /* Number of jobs */
+};
+
+struct columns;
+struct project;
+struct io;
+
+/** Join jobs to reservation instances **/
+int32_t join_usage(const struct columns *, const struct columns *,
+		   struct usage *);
+
+/** Write the utilisation of the reservations of a list of projects **/
+int32_t join_projects(struct io *, const struct project *);
+
+/** Free the utilisation of a project **/
+void join_free(struct usage *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* JOIN_H */
+/**
+ * \}
+ **/
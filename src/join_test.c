@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * \file join_test.c
+ * Check the sort-merge join gives the same utilisation as comparing
+ * every reservation instance with every job.
+ *
+ * \ingroup join
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "events.h"
+#include "join.h"
+
+/** Sets of events checked **/
+#define TEST_SETS       2000
+
+/**
+ * Fill a set of columns with random events on a small grid of times,
+ * so that starts and ends often coincide.
+ *
+ * \param[out] c     The columns.
+ * \param[in] n      The number of events.
+ * \param[in] len    The longest event.
+ **/
+static void
+test_fill(struct columns *c,
+	  int64_t n,
+	  int64_t len)
+{
+	int64_t i = 0;
+
+	c->n = n;
+	for (i = 0; i < n; ++i) {
+		c->epochs[i] = rand() % 3;
+		c->ids[i]    = i;
+		c->nodes[i]  = 1 + rand() % 4;
+		c->starts[i] = rand() % 40;
+		c->ends[i]   = c->starts[i] + rand() % len;
+	}
+}
+
+/**
+ * Join by comparing every reservation instance with every job.
+ *
+ * \param[in] rsv    The reservations.
+ * \param[in] jobs   The jobs.
+ * \param[out] u     The utilisation, with each array of rsv->n.
+ **/
+static void
+test_join(const struct columns *rsv,
+	  const struct columns *jobs,
+	  struct usage *u)
+{
+	int64_t i     = 0;
+	int64_t j     = 0;
+	int64_t start = 0;
+	int64_t end   = 0;
+	int64_t total = 0;
+
+	for (i = 0; i < rsv->n; ++i) {
+		u->used[i] = 0;
+		u->jobs[i] = 0;
+		for (j = 0; j < jobs->n; ++j) {
+			if (jobs->epochs[j] != rsv->epochs[i] ||
+			    jobs->starts[j] >= rsv->ends[i]) {
+				continue;
+			}
+			if (jobs->ends[j] > jobs->starts[j]) {
+				if (jobs->ends[j] <= rsv->starts[i]) {
+					continue;
+				}
+			} else if (jobs->starts[j] < rsv->starts[i]) {
+				continue;
+			}
+			start = jobs->starts[j] > rsv->starts[i] ?
+				jobs->starts[j] : rsv->starts[i];
+			end   = jobs->ends[j] < rsv->ends[i] ?
+				jobs->ends[j] : rsv->ends[i];
+			if (end > start) {
+				u->used[i] += jobs->nodes[j] * (end - start);
+			}
+			u->jobs[i] += 1;
+		}
+		total = rsv->nodes[i] * (rsv->ends[i] - rsv->starts[i]);
+		u->idle[i] = (total > u->used[i]) ? total - u->used[i] : 0;
+	}
+}
+
+int
+main(void)
+{
+	int64_t s   = 0;
+	int64_t i   = 0;
+	int64_t bad = 0;
+	int64_t jobs = 0;
+	struct columns rsv  = {0};
+	struct columns job  = {0};
+	struct usage u      = {0};
+	struct usage want   = {0};
+
+	columns_reserve(&rsv, 16);
+	columns_reserve(&job, 64);
+	want.used = malloc(16 * sizeof(int64_t));
+	want.idle = malloc(16 * sizeof(int64_t));
+	want.jobs = malloc(16 * sizeof(int64_t));
+	if (want.used == NULL || want.idle == NULL || want.jobs == NULL) {
+		fprintf(stderr, "unable to allocate memory\n");
+		return(EXIT_FAILURE);
+	}
+
+	srand(19);
+	for (s = 0; s < TEST_SETS; ++s) {
+		/* Reservations at times of day, jobs that may span them */
+		test_fill(&rsv, rand() % 17, 12);
+		test_fill(&job, rand() % 65, 30);
+		join_usage(&rsv, &job, &u);
+		test_join(&rsv, &job, &want);
+		for (i = 0; i < rsv.n; ++i) {
+			if (u.used[i] != want.used[i] ||
+			    u.idle[i] != want.idle[i] ||
+			    u.jobs[i] != want.jobs[i]) {
+				fprintf(stderr, "set %" PRId64 " instance %"
+					PRId64 ": used %" PRId64 " %" PRId64
+					", jobs %" PRId64 " %" PRId64 "\n",
+					s, i, u.used[i], want.used[i],
+					u.jobs[i], want.jobs[i]);
+				++bad;
+			}
+			jobs += u.jobs[i];
+		}
+		join_free(&u);
+	}
+	printf("%" PRId64 " sets, %" PRId64 " jobs joined, %" PRId64
+	       " mismatches\n", s, jobs, bad);
+
+	free(want.used);
+	free(want.idle);
+	free(want.jobs);
+	columns_free(&rsv);
+	columns_free(&job);
+
+	return(bad ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * \}
+ **/
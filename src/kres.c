@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file kres.c
+ * The kres library interface.
+ *
+ * \ingroup kres
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "mem.h"
+#include "events.h"
+#include "projects.h"
+#include "match.h"
+#include "kres.h"
+#include "kresint.h"
+
+/** A parser and the projects it has parsed **/
+struct kres {
+	struct arena   arena;           /* Memory for the projects */
+	struct pindex  index;           /* Index of the projects by name */
+	struct matcher match;           /* Matcher of the project names */
+	struct sources sources;         /* Logs already ingested */
+	struct parser  ps;              /* Parser state */
+	char           *stats_dir;      /* MOAB statistics directory */
+	char           *cache;          /* Cache directory, or NULL */
+	int32_t        nprojects;       /* Number of projects */
+	struct project **list;          /* The projects, in list order */
+};
+
+/**
+ * Copy a string.
+ *
+ * \param[in] s      The string, or NULL.
+ * \return           The copy, or NULL.
+ **/
+static char *
+kres_strdup(const char *s)
+{
+	char *d = NULL;
+
+	if (s) {
+		d = xmalloc((strlen(s) + 1) * sizeof(char));
+		strcpy(d, s);
+	}
+	return(d);
+}
+
+/**
+ * Load the reservations and open a parser.
+ *
+ * \param[in] o      The options.
+ * \param[out] kp    The parser, to be closed with kres_close().
+ * \retval 0         If the parser was opened.
+ * \retval 1         If the reservations could not be loaded.
+ **/
+int32_t
+kres_open(const struct kres_opts *o,
+	  struct kres **kp)
+{
+	int32_t i          = 0;
+	struct kres *k     = NULL;
+	struct project *p  = NULL;
+
+	*kp = NULL;
+	k = xmalloc(sizeof(struct kres));
+	memset(k, 0, sizeof(struct kres));
+	arena_init(&k->arena, 0);
+
+	if (project_rsv(o->res_file, &k->ps.projects, &k->arena) ||
+	    (o->res && project_select(&k->ps.projects, o->res))) {
+		project_free(k->ps.projects);
+		arena_free(&k->arena);
+		free(k);
+		return(EXIT_FAILURE);
+	}
+
+	project_index(k->ps.projects, &k->index);
+	matcher_build(&k->match, k->ps.projects);
+	k->stats_dir   = kres_strdup(o->stats_dir);
+	k->cache       = kres_strdup(o->cache);
+	k->ps.index    = &k->index;
+	k->ps.match    = &k->match;
+	k->ps.arena    = &k->arena;
+	k->ps.sources  = &k->sources;
+	k->ps.nthreads = o->threads > 0 ? o->threads : 1;
+	k->ps.progress = o->progress;
+	k->ps.cache    = k->cache;
+
+	for (p = k->ps.projects; p != NULL; p = p->next) {
+		k->nprojects += 1;
+	}
+	k->list = xmalloc((k->nprojects + 1) * sizeof(struct project *));
+	for (p = k->ps.projects; p != NULL; p = p->next) {
+		k->list[i++] = p;
+	}
+
+	*kp = k;
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Parse a single event log.
+ *
+ * Only the part of the log not already ingested is read.
+ *
+ * \param[in,out] k  The parser.
+ * \param[in] file   The event log.
+ * \retval 0         If it was sucessful
+ * \retval 1         If there was an error
+ **/
+int32_t
+kres_parse_file(struct kres *k,
+		const char *file)
+{
+	int32_t ierr = 0;
+	off_t start  = 0;
+
+	start = sources_find(&k->sources, file);
+	if ((ierr = event_parse(file, &start, &k->ps)) == 0) {
+		sources_set(&k->sources, file, start);
+	}
+
+	return(ierr);
+}
+
+/**
+ * Parse the event log of a day.
+ *
+ * \param[in,out] k  The parser.
+ * \param[in] offset The day, as an offset in days from today.
+ * \retval 0         If it was sucessful
+ * \retval 1         If there was an error
+ **/
+int32_t
+kres_parse_day(struct kres *k,
+	       int32_t offset)
+{
+	return(event_search(k->stats_dir, offset, &k->ps));
+}
+
+/**
+ * Parse the event logs of a range of days.
+ *
+ * \param[in,out] k  The parser.
+ * \param[in] from   The first day (UTC).
+ * \param[in] to     The last day (UTC).
+ * \retval 0         If it was sucessful
+ * \retval 1         If there was an error
+ **/
+int32_t
+kres_parse_range(struct kres *k,
+		 time_t from,
+		 time_t to)
+{
+	return(event_range(k->stats_dir, from, to, k->ps.nthreads, &k->ps));
+}
+
+/**
+ * The number of projects.
+ *
+ * \param[in] k      The parser.
+ * \return           The number of projects.
+ **/
+int32_t
+kres_projects(const struct kres *k)
+{
+	return(k->nprojects);
+}
+
+/**
+ * The name of a project.
+ *
+ * \param[in] k      The parser.
+ * \param[in] i      The project, from 0.
+ * \return           The name, or NULL if there is no such project.
+ **/
+const char *
+kres_name(const struct kres *k,
+	  int32_t i)
+{
+	if (i < 0 || i >= k->nprojects) {
+		return(NULL);
+	}
+	return(k->list[i]->name);
+}
+
+/**
+ * Point at a set of event columns.
+ *
+ * \param[in] src    The columns.
+ * \param[out] c     Pointers to the columns.
+ **/
+static void
+kres_point(const struct columns *src,
+	   struct kres_columns *c)
+{
+	c->n      = src->n;
+	c->epochs = src->epochs;
+	c->ids    = src->ids;
+	c->nodes  = src->nodes;
+	c->starts = src->starts;
+	c->ends   = src->ends;
+}
+
+/**
+ * Point at the reservations of a project.
+ *
+ * \param[in] k      The parser.
+ * \param[in] i      The project, from 0.
+ * \param[out] c     The reservation columns.
+ * \retval 0         If there is such a project.
+ * \retval 1         If there is not.
+ **/
+int32_t
+kres_reservations(const struct kres *k,
+		  int32_t i,
+		  struct kres_columns *c)
+{
+	if (i < 0 || i >= k->nprojects) {
+		return(EXIT_FAILURE);
+	}
+	kres_point(&k->list[i]->reservations, c);
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Point at the jobs of a project.
+ *
+ * \param[in] k      The parser.
+ * \param[in] i      The project, from 0.
+ * \param[out] c     The job columns.
+ * \retval 0         If there is such a project.
+ * \retval 1         If there is not.
+ **/
+int32_t
+kres_jobs(const struct kres *k,
+	  int32_t i,
+	  struct kres_columns *c)
+{
+	if (i < 0 || i >= k->nprojects) {
+		return(EXIT_FAILURE);
+	}
+	kres_point(&k->list[i]->jobs, c);
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * What has been parsed.
+ *
+ * \param[in] k      The parser.
+ * \param[out] c     The counters.
+ **/
+void
+kres_counts(const struct kres *k,
+	    struct kres_counts *c)
+{
+	c->lines     = k->ps.counts.lines;
+	c->bytes     = k->ps.counts.bytes;
+	c->jobs      = k->ps.counts.jobs;
+	c->rsvs      = k->ps.counts.rsvs;
+	c->unmatched = k->ps.counts.unmatched;
+	c->malformed = k->ps.counts.malformed;
+}
+
+/**
+ * The parser state.
+ *
+ * The kres program reads and writes the projects and ingested logs
+ * through this. It is not exported from the shared library, callers
+ * of the library should not need it.
+ *
+ * \param[in] k      The parser.
+ * \return           The parser state.
+ **/
+struct parser *
+kresint_parser(struct kres *k)
+{
+	return(&k->ps);
+}
+
+/**
+ * Close a parser, freeing the projects and their columns.
+ *
+ * \param[in,out] k  The parser.
+ **/
+void
+kres_close(struct kres *k)
+{
+	if (k == NULL) {
+		return;
+	}
+	sources_free(&k->sources);
+	matcher_free(&k->match);
+	project_index_free(&k->index);
+	project_free(k->ps.projects);
+	arena_free(&k->arena);
+	free(k->list);
+	free(k->stats_dir);
+	free(k->cache);
+	free(k);
+}
+
+/**
+ * \}
+ **/
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file kres.h
+ * The kres library, parsing MOAB event logs into columns of
+ * reservation and job events.
+ *
+ * A typical use is
+ *
+ *     struct kres *k = NULL;
+ *     struct kres_opts o = {0};
+ *     struct kres_columns c;
+ *
+ *     o.res_file = "jet.reservations.cfg";
+ *     o.stats_dir = "/misc/moab/moabhome/stats";
+ *     kres_open(&o, &k);
+ *     kres_parse_range(k, from, to);
+ *     for (i = 0; i < kres_projects(k); ++i) {
+ *             kres_jobs(k, i, &c);
+ *             ...
+ *     }
+ *     kres_close(k);
+ *
+ * The columns point into the library's own buffers, they are valid
+ * until the next parse or kres_close().
+ *
+ * \ingroup kres
+ * \{
+ **/
+
+#ifndef KRES_H
+#define KRES_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Version of this interface **/
+#define KRES_API_VERSION        1
+
+/** How to open the library **/
+struct kres_opts {
+	const char *res_file;           /* Reservation configuration file */
+	const char *res;                /* A single reservation, or NULL */
+	const char *stats_dir;          /* MOAB statistics directory */
+	const char *cache;              /* Cache directory, or NULL */
+	int32_t    threads;             /* Threads to parse with, 0 for 1 */
+	int32_t    progress;            /* Print each event log to stdout */
+};
+
+/** Columns of events, one element per event **/
+struct kres_columns {
+	int64_t       n;                /* Number of events */
+	const uint8_t *epochs;
+	const int64_t *ids;
+	const int64_t *nodes;
+	const int64_t *starts;
+	const int64_t *ends;
+};
+
+/** Parse counters, as the kres program reports them **/
+struct kres_counts {
+	int64_t lines;                  /* Lines read */
+	int64_t bytes;                  /* Bytes read */
+	int64_t jobs;                   /* JOBEND records added */
+	int64_t rsvs;                   /* RSVEND records matched */
+	int64_t unmatched;              /* JOBEND with an unknown REQRSV */
+	int64_t malformed;              /* Matched records with a bad field */
+};
+
+/** A parser and the projects it has parsed, opaque to callers **/
+struct kres;
+
+/** Load the reservations and open a parser **/
+int32_t kres_open(const struct kres_opts *, struct kres **);
+
+/** Parse a single event log **/
+int32_t kres_parse_file(struct kres *, const char *);
+
+/** Parse the event log of a day, as an offset from today **/
+int32_t kres_parse_day(struct kres *, int32_t);
+
+/** Parse the event logs of a range of days **/
+int32_t kres_parse_range(struct kres *, time_t, time_t);
+
+/** Number of projects **/
+int32_t kres_projects(const struct kres *);
+
+/** Name of a project **/
+const char *kres_name(const struct kres *, int32_t);
+
+/** Reservations of a project **/
+int32_t kres_reservations(const struct kres *, int32_t,
+			  struct kres_columns *);
+
+/** Jobs of a project **/
+int32_t kres_jobs(const struct kres *, int32_t, struct kres_columns *);
+
+/** What has been parsed **/
+void kres_counts(const struct kres *, struct kres_counts *);
+
+/** Close a parser, freeing the projects and their columns **/
+void kres_close(struct kres *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* KRES_H */
+/**
+ * \}
+ **/
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file kresgen.c
+ * Generate synthetic MOAB event logs for benchmarking.
+ *
+ * Writes a number of daily event logs, ending today, made of JOBEND,
+ * RSVEND and other records in the layout MOAB uses, along with a
+ * reservation configuration naming the reservations they refer to.
+ *
+ * \ingroup bench
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <limits.h>
+#include <err.h>
+
+#include "config.h"
+
+/** Length of a JOBEND line before its task map is padded **/
+#define GEN_JOBLEN      300
+
+/** First record number of a day, wide enough that the columns of the
+ * records do not move as it grows **/
+#define GEN_SEQ         10000000
+
+/** Largest task map padding **/
+#define GEN_TASKMAP     4096
+
+/** Epochs given to each reservation **/
+static const int epochs[] = {0, 6, 12, 18};
+
+/** Number of epochs **/
+static const int nepochs = sizeof(epochs)/sizeof(int);
+
+/** Generator settings **/
+struct gen {
+	const char *dir;                /* Output directory */
+	int32_t days;                   /* Number of daily logs */
+	int64_t size;                   /* Bytes per log */
+	double  ratio;                  /* JOBEND records per RSVEND */
+	int32_t length;                 /* Least JOBEND line length */
+	int32_t nres;                   /* Number of reservations */
+	uint64_t seed;                  /* Random seed */
+};
+
+/** Totals over everything written **/
+struct totals {
+	int64_t lines;
+	int64_t bytes;
+	int64_t jobs;
+	int64_t rsvs;
+};
+
+/** State of the random number generator **/
+static uint64_t state = 0;
+
+/**
+ * A 64 bit xorshift random number.
+ **/
+static uint64_t
+gen_rand(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return(state);
+}
+
+/**
+ * A uniform random number in [lo, hi].
+ **/
+static int64_t
+gen_range(int64_t lo,
+	  int64_t hi)
+{
+	return(lo + (int64_t)(gen_rand() % (uint64_t)(hi - lo + 1)));
+}
+
+/**
+ * A uniform random number in [0, 1).
+ **/
+static double
+gen_unit(void)
+{
+	return((gen_rand() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/**
+ * Parse a size with an optional k, M or G suffix.
+ **/
+static int64_t
+gen_size(const char *str)
+{
+	char *ptr = NULL;
+	int64_t n = strtoll(str, &ptr, 10);
+
+	switch (*ptr) {
+		case 'k': case 'K': n <<= 10; break;
+		case 'm': case 'M': n <<= 20; break;
+		case 'g': case 'G': n <<= 30; break;
+		case '\0': break;
+		default: n = -1; break;
+	}
+	return(n);
+}
+
+/**
+ * Write the reservation configuration.
+ *
+ * @param[in]  g         The generator settings.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+gen_config(const struct gen *g)
+{
+	int32_t i  = 0;
+	int32_t j  = 0;
+	char name[PATH_MAX] = {0};
+	FILE *ofp  = NULL;
+
+	snprintf(name, sizeof(name), "%s/reservations.cfg", g->dir);
+	if ((ofp = fopen(name, "w")) == NULL) {
+		warn("unable to create %s", name);
+		return(EXIT_FAILURE);
+	}
+	for (i = 0; i < g->nres; ++i) {
+		for (j = 0; j < nepochs; ++j) {
+			fprintf(ofp, "### Reservation rsv%03d-%02dz\n", i, epochs[j]);
+			fprintf(ofp, "SRCFG[rsv%03d-%02dz] PERIOD=DAY\n", i, epochs[j]);
+		}
+	}
+	fclose(ofp);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Write the event log of a single day.
+ *
+ * Records are spread evenly over the day. Of every four records three
+ * are JOBEND or RSVEND, in the given ratio, the rest are JOBSTART and
+ * scheduler records that are of no interest. One in five jobs names a
+ * reservation without its epoch and some name no known reservation.
+ *
+ * @param[in]  g         The generator settings.
+ * @param[in]  day       The start of the day (UTC).
+ * @param[in,out] tot    The totals.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+gen_day(const struct gen *g,
+	time_t day,
+	struct totals *tot)
+{
+	int32_t i       = 0;
+	int32_t ep      = 0;
+	int32_t inst    = 0;
+	int32_t pad     = 0;
+	int64_t res     = 0;
+	int64_t bytes   = 0;
+	int64_t seq     = GEN_SEQ;
+	int64_t jid     = 500000;
+	int64_t start   = 0;
+	int len         = 0;
+	double  u       = 0.0;
+	double  pjob    = 0.0;
+	time_t  t       = 0;
+	struct tm tm    = {0};
+	char hms[16]    = {0};
+	char rname[16]  = {0};
+	char fname[64]  = {0};
+	char name[PATH_MAX] = {0};
+	char taskmap[GEN_TASKMAP] = {0};
+	FILE *ofp       = NULL;
+
+	gmtime_r(&day, &tm);
+	strftime(fname, sizeof(fname), "events.%a_%b_%d_%Y", &tm);
+	snprintf(name, sizeof(name), "%s/%s", g->dir, fname);
+	if ((ofp = fopen(name, "w")) == NULL) {
+		warn("unable to create %s", name);
+		return(EXIT_FAILURE);
+	}
+	setvbuf(ofp, NULL, _IOFBF, 1 << 20);
+
+	/* Pad the task map of each job out to the line length */
+	for (i = 0; pad < g->length - GEN_JOBLEN &&
+	     pad < GEN_TASKMAP - 8; ++i) {
+		pad += sprintf(taskmap + pad, "n%04d,", i);
+	}
+
+	pjob = 0.75 * g->ratio / (g->ratio + 1.0);
+	while (bytes < g->size) {
+		t = day + (time_t)((double)bytes / g->size * SECS_IN_DAY);
+		gmtime_r(&t, &tm);
+		strftime(hms, sizeof(hms), "%H:%M:%S", &tm);
+		seq += 1;
+
+		res = gen_range(0, g->nres);
+		ep  = epochs[gen_range(0, nepochs - 1)];
+		if (res == g->nres) {
+			strcpy(rname, "other");
+		} else {
+			snprintf(rname, sizeof(rname), "rsv%03d", (int)res);
+		}
+
+		u = gen_unit();
+		if (u < pjob) {
+			jid += 1;
+			start = t - gen_range(10, 3000);
+			len = fprintf(ofp, "%s %" PRId64 ":%" PRId64 " job       "
+				      "%" PRId64 "    JOBEND          %" PRId64
+				      " REQUESTEDNC=%d REQUESTEDTC=24 UNAME=u"
+				      " GNAME=g WCLIMIT=28800 STATE=Completed"
+				      " RCLASS=[batch] SUBMITTIME=%" PRId64
+				      " TASKS=24 PARTITION=jet TASKMAP=%sn1,n2"
+				      " STARTTIME=%" PRId64 " COMPLETETIME=%"
+				      PRId64 " REQRSV=%s", hms, (int64_t)t, seq,
+				      jid, jid, (int)gen_range(1, 64),
+				      start - 100, taskmap, start, (int64_t)t,
+				      rname);
+			if (gen_unit() < 0.8) {
+				len += fprintf(ofp, "-%02dz", ep);
+			}
+			len += fprintf(ofp, " EXITCODE=0 DRMJID=%" PRId64
+				       ".bqs1\n", jid);
+			tot->jobs += 1;
+		} else if (u < 0.75) {
+			inst = gen_range(1, 40);
+			len = fprintf(ofp, "%s %" PRId64 ":%" PRId64 " rsv       "
+				      "%s-%02dz.%d    RSVEND          "
+				      "%s-%02dz.%d RSVTYPE=User "
+				      "NAME=%s-%02dz.%d STARTTIME=%" PRId64
+				      " ENDTIME=%" PRId64 " ALLOCTC=%d "
+				      "ALLOCNODECOUNT=3 RSVGROUP=%s-%02dz\n",
+				      hms, (int64_t)t, seq, rname, ep, inst,
+				      rname, ep, inst, rname, ep, inst,
+				      (int64_t)(t - gen_range(0, 9999)),
+				      (int64_t)(day + SECS_IN_DAY +
+						(inst % 7) * 3600),
+				      (int)gen_range(1, 200), rname, ep);
+			tot->rsvs += 1;
+		} else if (u < 0.875) {
+			jid += 1;
+			len = fprintf(ofp, "%s %" PRId64 ":%" PRId64 " job       "
+				      "%" PRId64 "    JOBSTART        %" PRId64
+				      " REQUESTEDNC=2 STARTTIME=%" PRId64 "\n",
+				      hms, (int64_t)t, seq, jid, jid,
+				      (int64_t)t);
+		} else {
+			len = fprintf(ofp, "%s %" PRId64 ":%" PRId64 " sched     "
+				      "Moab       SCHEDCOMMAND    Moab scheduler"
+				      " command\n", hms, (int64_t)t, seq);
+		}
+		if (len < 0) {
+			break;
+		}
+		bytes += len;
+		tot->lines += 1;
+	}
+
+	if (fclose(ofp) != 0 || len < 0) {
+		warn("unable to write %s", name);
+		return(EXIT_FAILURE);
+	}
+	tot->bytes += bytes;
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Print a short usage statement.
+ **/
+static void
+gen_usage(void)
+{
+	printf("\
+usage: kresgen -o DIR [-d DAYS] [-s SIZE] [-r RATIO] [-l LENGTH] [-n NRES]\n\
+               [-S SEED]\n\
+\n\
+  -o   The directory to write the event logs and reservations.cfg to.\n\
+  -d   The number of daily event logs, ending today (default 1).\n\
+  -s   The size of each event log, with a k, M or G suffix (default 64M).\n\
+  -r   The number of JOBEND records per RSVEND record (default 20).\n\
+  -l   The least length of a JOBEND line, padding the task map.\n\
+  -n   The number of reservations, each with four epochs (default 8).\n\
+  -S   The random seed (default 1).\n\
+\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt           = 0;
+	int32_t i         = 0;
+	time_t now        = 0;
+	time_t first      = 0;
+	struct tm tm      = {0};
+	char date[16]     = {0};
+	struct totals tot = {0};
+	struct gen g      = {
+		.dir    = NULL,
+		.days   = 1,
+		.size   = 64 << 20,
+		.ratio  = 20.0,
+		.length = 0,
+		.nres   = 8,
+		.seed   = 1
+	};
+
+	while ((opt = getopt(argc, argv, "ho:d:s:r:l:n:S:")) != -1) {
+		switch (opt) {
+			case 'o':
+				g.dir = optarg;
+				break;
+			case 'd':
+				g.days = strtol(optarg, NULL, 10);
+				break;
+			case 's':
+				g.size = gen_size(optarg);
+				break;
+			case 'r':
+				g.ratio = strtod(optarg, NULL);
+				break;
+			case 'l':
+				g.length = strtol(optarg, NULL, 10);
+				break;
+			case 'n':
+				g.nres = strtol(optarg, NULL, 10);
+				break;
+			case 'S':
+				g.seed = strtoull(optarg, NULL, 10);
+				break;
+			default:
+				gen_usage();
+		}
+	}
+	if (g.dir == NULL || g.days < 1 || g.size <= 0 || g.ratio <= 0.0 ||
+	    g.nres < 1 || g.nres > 999) {
+		gen_usage();
+	}
+	state = g.seed ? g.seed : 1;
+
+	if (gen_config(&g)) {
+		return(EXIT_FAILURE);
+	}
+
+	now   = time(NULL);
+	first = now - now % SECS_IN_DAY - (g.days - 1) * SECS_IN_DAY;
+	for (i = 0; i < g.days; ++i) {
+		if (gen_day(&g, first + i * SECS_IN_DAY, &tot)) {
+			return(EXIT_FAILURE);
+		}
+	}
+
+	/* A summary for the benchmark to read */
+	gmtime_r(&first, &tm);
+	strftime(date, sizeof(date), "%Y-%m-%d", &tm);
+	printf("From: %s\n", date);
+	printf("Lines: %" PRId64 "\n", tot.lines);
+	printf("Bytes: %" PRId64 "\n", tot.bytes);
+	printf("Jobs: %" PRId64 "\n", tot.jobs);
+	printf("Reservations: %" PRId64 "\n", tot.rsvs);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * \}
+ **/
@@ -38,107 +38,114 @@
 #include "events.h"
 #include "projects.h"
 #include "io.h"
+#include "follow.h"
+#include "stats.h"
+#include "join.h"
+#include "kres.h"
+#include "kresint.h"
+#include "serve.h"
 
 int
 main(int argc, char **argv)
 {
 	int32_t ierr      = 0;
-	int32_t i         = 0;
 	struct args a     = {0};
-	struct project *projects = NULL;
-	hid_t  fid        = 0;
+	struct kres_opts o = {0};
+	struct kres *k    = NULL;
+	struct parser *ps = NULL;
+	struct io io      = {0};
 	struct project *pptr = NULL;
-	/*
-	struct event *r   = NULL;
-	struct event *j   = NULL;
-	struct tm gmts    = {0};
-	struct tm gmte    = {0};
-	char tstart[20]   = {0};
-	char tend[20]     = {0};
-	const char tfmt[] = "%Y %m %d %H:%M:%S";
-	const char rhdr[] = "Reservation\tEpoch\tStart\t\t\tEnd\t\t\tNodes\n";
-	const char rfmt[] = "%-10s\t%02d\t%-20s\t%-20s\t%4d\n";
-	const char jfmt[] = "%10d\t\t%-20s\t%-20s\t%4d\n";
-	*/
+	struct stats st   = {0};
 
 
 	if (args_parse(argc, argv, &a)) {
 		return(EXIT_FAILURE);
 	}
 
-	/* Load the reservations */
-	if (project_rsv(a.res_file, &projects)) {
-		return(EXIT_FAILURE);
+	/* Hold the events in memory and answer queries on them */
+	if (a.daemon) {
+		ierr = serve_run(&a);
+		args_free(&a);
+		return(ierr ? EXIT_FAILURE : EXIT_SUCCESS);
 	}
 
-	/* Parse the event log */
-	if (event_search(a.stats_dir, a.offset, (void *)&projects)) {
+	/* Load the reservations, only a single one if asked to */
+	st.load = stats_clock();
+	o.res_file  = a.res_file;
+	o.res       = a.res;
+	o.stats_dir = a.stats_dir;
+	o.cache     = a.cache;
+	o.threads   = a.threads;
+	o.progress  = 1;
+	if (kres_open(&o, &k)) {
 		return(EXIT_FAILURE);
 	}
+	ps = kresint_parser(k);
 
-	/*
-	pptr = projects;
-	if (pptr != NULL) {
-		printf(rhdr);
+	/* Find the event logs and reservations already in the output */
+	if (io_open(a.output, &a, &io) || io_reservation(&io, a.res) ||
+	    io_sources_read(&io, ps->sources)) {
+		return(EXIT_FAILURE);
 	}
-	while (pptr != NULL) {
-		r = pptr->reservations;
-		while (r != NULL) {
-			gmtime_r(&(r->start), &gmts);
-			gmtime_r(&(r->end),   &gmte);
-			strftime(tstart, sizeof(tstart), tfmt, &gmts);
-			strftime(tend,   sizeof(tend),   tfmt, &gmte);
-			printf(rfmt, r->name, r->epoch, tstart, tend, r->nodes);
-			j = pptr->jobs;
-			while (j != NULL) {
-				if (j->epoch == r->epoch) {
-					gmtime_r(&(j->start), &gmts);
-					gmtime_r(&(j->end),   &gmte);
-					strftime(tstart, sizeof(tstart), tfmt, &gmts);
-					strftime(tend,   sizeof(tend),   tfmt, &gmte);
-					printf(jfmt, j->id, tstart, tend, j->nodes);
-				}
-				j = j->next;
-			}
-			r = r->next;
+	for (pptr = ps->projects; pptr != NULL; pptr = pptr->next) {
+		if (io_read(&io, pptr)) {
+			return(EXIT_FAILURE);
 		}
-		pptr = pptr->next;
 	}
-	*/
-
-	io_open(a.output, &fid);
-	pptr = projects;
-	while (pptr != NULL) {
-		io_write(fid, pptr);
-		pptr = pptr->next;
-	}
-	io_close(fid);
-
-	/* Clean up */
-#if 0
-	while ((p = pptr) != NULL) {
-		pptr = pptr->next;
-		r = pptr->reservations;
-		while (r1 != NULL) {
-			if (r->name) {
-				free(r->name);
-			}
-			free(r);
-			r->next;
+	st.rows = stats_rows(ps->projects);
+	st.load = stats_clock() - st.load;
+
+	/* Parse the event logs */
+	st.parse = stats_clock();
+	if (a.follow) {
+		if (follow_run(&a, ps, &io)) {
+			return(EXIT_FAILURE);
 		}
-		j = pptr->jobs;
-		while (r != NULL) {
-			if (r->name) {
-				free(r->name);
-			}
-			free(r);
+	} else if (a.from) {
+		/* Write each day out while the later ones are parsed */
+		if (io.flat == NULL) {
+			ps->flush     = io_drain;
+			ps->flush_arg = &io;
 		}
-		if (pptr->name) {
-			free(pptr->name);
+		if (kres_parse_range(k, a.from, a.to)) {
+			return(EXIT_FAILURE);
 		}
-		free(p);
+	} else if (kres_parse_day(k, a.offset)) {
+		return(EXIT_FAILURE);
+	}
+	/* Time held up by the range's writer is counted as writing */
+	st.parse = stats_clock() - st.parse - ps->waiting;
+	st.added = stats_rows(ps->projects) - st.rows;
+	st.counts = ps->counts;
+
+	st.write = stats_clock();
+	if (!a.follow && io_flush(&io, ps->projects, ps->sources)) {
+		return(EXIT_FAILURE);
+	}
+	st.write = stats_clock() - st.write + ps->flushing;
+	st.drain = ps->flushing;
+
+	/* Join the jobs to the reservation instances they ran in */
+	st.join = stats_clock();
+	if (join_projects(&io, ps->projects)) {
+		return(EXIT_FAILURE);
+	}
+	st.join = stats_clock() - st.join;
+	st.raw    = io.raw;
+	st.stored = io.stored;
+	io_close(&io);
+
+	if (a.verbose) {
+		stats_print(&st);
+		arena_stats(ps->arena, "Projects");
+		project_stats(ps->projects);
 	}
-#endif
+	if (a.json && stats_json(a.json, &st)) {
+		return(EXIT_FAILURE);
+	}
+
+	/* Clean up */
+	kres_close(k);
 
 	if (args_free(&a)) {
 		return(EXIT_FAILURE);
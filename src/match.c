@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file match.c
+ * Multi-pattern matching of reservation names.
+ *
+ * Most JOBEND records are for jobs outside of any reservation. Rather
+ * than look up the REQRSV value of every record, an Aho-Corasick
+ * automaton is built over "REQRSV=<name>" for each project, so a
+ * record naming no known reservation is passed over without a lookup
+ * or a copy of the name.
+ *
+ * \ingroup match
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "config.h"
+#include "mem.h"
+#include "events.h"
+#include "projects.h"
+#include "scan.h"
+#include "match.h"
+
+/**
+ * Give each byte of a key a class of its own.
+ *
+ * \param[in,out] m  The matcher.
+ * \param[in] k      The key.
+ * \param[in] n      The length of the key.
+ **/
+static void
+matcher_classify(struct matcher *m,
+		 const char *k,
+		 size_t n)
+{
+	size_t i        = 0;
+	unsigned char c = 0;
+
+	for (i = 0; i < n; ++i) {
+		c = (unsigned char)k[i];
+		if (m->classes[c] == 0) {
+			m->classes[c] = m->nclasses++;
+		}
+	}
+}
+
+/**
+ * Add a key to the trie of a matcher.
+ *
+ * \param[in,out] m  The matcher.
+ * \param[in] s      The state to start from.
+ * \param[in] k      The key.
+ * \param[in] n      The length of the key.
+ * \return           The state at the end of the key.
+ **/
+static int32_t
+matcher_insert(struct matcher *m,
+	       int32_t s,
+	       const char *k,
+	       size_t n)
+{
+	size_t i  = 0;
+	int32_t *t = NULL;
+
+	for (i = 0; i < n; ++i) {
+		t = &m->next[s * m->nclasses + m->classes[(unsigned char)k[i]]];
+		if (*t == 0) {
+			*t = m->nstates++;
+		}
+		s = *t;
+	}
+	return(s);
+}
+
+/**
+ * Build a matcher for the names of a list of projects.
+ *
+ * The keys are put in a trie, which is then turned into a complete
+ * automaton by following the failure links breadth first, so the
+ * search takes one transition per byte.
+ *
+ * \param[out] m     The matcher.
+ * \param[in] p      The first project in the list.
+ * \retval 0         If the matcher was built.
+ **/
+int32_t
+matcher_build(struct matcher *m,
+	      const struct project *p)
+{
+	static const char key[] = MATCH_KEY;
+	const size_t nkey   = sizeof(key) - 1;
+	size_t n            = 0;
+	size_t cap          = 1 + nkey;
+	int32_t c           = 0;
+	int32_t s           = 0;
+	int32_t t           = 0;
+	int32_t f           = 0;
+	int32_t head        = 0;
+	int32_t tail        = 0;
+	int32_t *fail       = NULL;
+	int32_t *queue      = NULL;
+	const struct project *q = NULL;
+
+	memset(m, 0, sizeof(struct matcher));
+	m->nclasses = 1;
+	matcher_classify(m, key, nkey);
+	for (q = p; q != NULL; q = q->next) {
+		n = strlen(q->name);
+		matcher_classify(m, q->name, n);
+		cap += n;
+	}
+
+	/* The trie has at most a state per byte of the keys */
+	m->next = xmalloc(cap * m->nclasses * sizeof(int32_t));
+	memset(m->next, 0, cap * m->nclasses * sizeof(int32_t));
+	m->out = xmalloc(cap * sizeof(int32_t));
+	memset(m->out, 0, cap * sizeof(int32_t));
+	m->nstates = 1;
+	m->key = matcher_insert(m, 0, key, nkey);
+	for (q = p; q != NULL; q = q->next) {
+		n = strlen(q->name);
+		m->out[matcher_insert(m, m->key, q->name, n)] = n;
+	}
+
+	/* Fill in the missing transitions breadth first */
+	fail  = xmalloc(m->nstates * sizeof(int32_t));
+	queue = xmalloc(m->nstates * sizeof(int32_t));
+	for (c = 0; c < m->nclasses; ++c) {
+		if ((t = m->next[c]) != 0) {
+			fail[t] = 0;
+			queue[tail++] = t;
+		}
+	}
+	while (head < tail) {
+		s = queue[head++];
+		if (m->out[s] == 0) {
+			m->out[s] = m->out[fail[s]];
+		}
+		for (c = 0; c < m->nclasses; ++c) {
+			t = m->next[s * m->nclasses + c];
+			f = m->next[fail[s] * m->nclasses + c];
+			if (t != 0) {
+				fail[t] = f;
+				queue[tail++] = t;
+			} else {
+				m->next[s * m->nclasses + c] = f;
+			}
+		}
+	}
+
+	free(queue);
+	free(fail);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Find a known reservation name within a line.
+ *
+ * Stepping the automaton a byte at a time through the whole line is
+ * slower than finding MATCH_KEY with the vectorized key search, so the
+ * key is found first and the automaton is only stepped, from the state
+ * after the key, through the value that follows it.
+ *
+ * A name is only taken as found when it is the whole REQRSV value,
+ * that is followed by the end of the value or by an epoch (-NNz).
+ *
+ * \param[in] m      The matcher.
+ * \param[in] line   The line to search.
+ * \param[in] n      The length of the line.
+ * \param[out] nlen  The length of the name found.
+ * \param[out] seen  Set if the line has a REQRSV value at all.
+ * \return           The name within the line, or NULL.
+ **/
+const char *
+matcher_find(const struct matcher *m,
+	     const char *restrict line,
+	     size_t n,
+	     size_t *nlen,
+	     int32_t *seen)
+{
+	static const char key[] = MATCH_KEY;
+	const size_t nkey   = sizeof(key) - 1;
+	size_t i            = 0;
+	size_t e            = 0;
+	size_t v            = 0;
+	int32_t s           = 0;
+	const char *k       = NULL;
+
+	while ((k = scan_find(line + v, n - v, key, nkey)) != NULL) {
+		*seen = 1;
+		v = k - line + nkey;
+		s = m->key;
+		for (i = v; i < n && line[i] != ' '; ++i) {
+			s = m->next[s * m->nclasses +
+				    m->classes[(unsigned char)line[i]]];
+			if (m->out[s] == 0 || i + 1 - m->out[s] != v) {
+				continue;
+			}
+			e = i + 1;
+			if (e == n || line[e] == ' ') {
+				*nlen = m->out[s];
+				return(line + v);
+			}
+			if (e + 4 <= n && line[e] == '-'               &&
+			    isdigit((unsigned char)line[e + 1])        &&
+			    isdigit((unsigned char)line[e + 2])        &&
+			    line[e + 3] == 'z'                         &&
+			    (e + 4 == n || line[e + 4] == ' ')) {
+				*nlen = m->out[s];
+				return(line + v);
+			}
+		}
+	}
+
+	return(NULL);
+}
+
+/**
+ * Free a matcher.
+ *
+ * \param[in,out] m  The matcher.
+ **/
+void
+matcher_free(struct matcher *m)
+{
+	free(m->next);
+	free(m->out);
+	memset(m, 0, sizeof(struct matcher));
+}
+
+/**
+ * \}
+ **/
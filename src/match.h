@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file match.h
+ * Multi-pattern matching of reservation names.
+ *
+ * \ingroup match
+ * \{
+ **/
+
+#ifndef MATCH_H
+#define MATCH_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Key that precedes a reservation name in a JOBEND record **/
+#define MATCH_KEY       "REQRSV="
+
+/** Aho-Corasick automaton over the keys of a list of projects.
+ * The transitions are a dense table with a row per state and a column
+ * per class of byte. Every byte that appears in no key shares class 0.
+ **/
+struct matcher {
+	int32_t nstates;                /* Number of states */
+	int32_t nclasses;               /* Number of byte classes */
+	int32_t key;                    /* State after MATCH_KEY */
+	uint16_t classes[256];          /* Class of each byte */
+	int32_t *next;                  /* Transitions, nstates * nclasses */
+	int32_t *out;                   /* Name length accepted by a state */
+};
+
+struct project;
+
+/** Build a matcher for the names of a list of projects **/
+int32_t matcher_build(struct matcher *, const struct project *);
+
+/** Find a known reservation name within a line **/
+const char *matcher_find(const struct matcher *, const char *restrict,
+			 size_t, size_t *, int32_t *);
+
+/** Free a matcher **/
+void matcher_free(struct matcher *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* MATCH_H */
+/**
+ * \}
+ **/
@@ -40,10 +40,18 @@
 #include <err.h>
 #include <sysexits.h>
 #include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 #include "atts.h"
 #include "mem.h"
 
+/** Default size of an arena block **/
+#define ARENA_BLOCK     (1 << 16)
+
+/** Alignment of arena allocations **/
+#define ARENA_ALIGN     16
+
 /**
  * Allocate a block of memory and set all entries to zero.
  * If there is an error in obtaining the memory err()
@@ -103,6 +111,124 @@ xmemalign(size_t n)
 	return NULL;
 }
 
+/**
+ * Resize a block of memory (any new memory is not touched/set).
+ * If there is an error in obtaining the memory err()
+ * is called, terminating the program.
+ *
+ * \param[in] ptr The memory to resize, may be NULL.
+ * \param[in] n   The new amount of memory in bytes.
+ *
+ * \return A pointer to the resized memory.
+ **/
+ATT_MSIZE(2)
+void *
+xrealloc(void *ptr, size_t n)
+{
+	void *new = NULL;		/* New pointer to memory location */
+
+	new = realloc(ptr, n);
+
+	if (new) {
+		return new;
+	} else {
+		errx(EX_SOFTWARE,
+		     "out of memory (unable to allocate %ld bytes)", n);
+	}
+
+	/* should never get here */
+	return NULL;
+}
+
+/**
+ * Initialise an arena.
+ *
+ * \param[out] a     The arena.
+ * \param[in] bsize  The size of each block, 0 for the default.
+ **/
+void
+arena_init(struct arena *a, size_t bsize)
+{
+	memset(a, 0, sizeof(struct arena));
+	a->bsize = bsize ? bsize : ARENA_BLOCK;
+}
+
+/**
+ * Allocate memory from an arena (the memory is not touched/set).
+ *
+ * Memory is handed out from the current block, a new block is
+ * allocated when it is full. Requests larger than a block get a block
+ * of their own. Nothing is freed until the arena is released.
+ *
+ * \param[in,out] a  The arena.
+ * \param[in] n      The amount of memory in bytes.
+ *
+ * \return A pointer to the newly allocated memory.
+ **/
+ATT_MSIZE(2)
+ATT_MALLOC
+void *
+arena_alloc(struct arena *a, size_t n)
+{
+	size_t size      = 0;
+	struct ablock *b = a->head;
+
+	/* Keep every allocation aligned for any type */
+	n = (n + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+
+	if (b == NULL || b->size - b->used < n) {
+		size = n > a->bsize ? n : a->bsize;
+		b = xmemalign(sizeof(struct ablock) + size);
+		b->size = size;
+		b->used = 0;
+		b->next = a->head;
+		a->head = b;
+		a->nblocks  += 1;
+		a->reserved += size;
+		if (a->reserved > a->peak) {
+			a->peak = a->reserved;
+		}
+	}
+
+	a->nalloc += 1;
+	a->bytes  += n;
+	b->used   += n;
+
+	return(b->data + b->used - n);
+}
+
+/**
+ * Print the allocation statistics of an arena.
+ *
+ * \param[in] a      The arena.
+ * \param[in] name   What the arena holds.
+ **/
+void
+arena_stats(const struct arena *a, const char *name)
+{
+	printf("%s: %" PRIu64 " allocations, %" PRIu64 " bytes, "
+	       "%" PRIu64 " blocks, peak %" PRIu64 " bytes\n",
+	       name, a->nalloc, a->bytes, a->nblocks, a->peak);
+}
+
+/**
+ * Release all the memory of an arena.
+ *
+ * \param[in,out] a  The arena.
+ **/
+void
+arena_free(struct arena *a)
+{
+	struct ablock *b = NULL;
+
+	while ((b = a->head) != NULL) {
+		a->head = b->next;
+		free(b);
+	}
+	a->nblocks  = 0;
+	a->reserved = 0;
+}
+
 /**
  * \}
  **/
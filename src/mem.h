@@ -42,12 +42,46 @@ extern "C"
 {
 #endif
 
+/** A block of memory owned by an arena **/
+struct ablock {
+	struct ablock *next;
+	size_t        size;             /* Usable bytes in data */
+	size_t        used;             /* Bytes handed out */
+	char          data[];
+};
+
+/** Bump allocator for objects that live as long as a parse **/
+struct arena {
+	struct ablock *head;            /* Block currently allocated from */
+	size_t        bsize;            /* Size of a new block */
+	uint64_t      nalloc;           /* Number of allocations */
+	uint64_t      bytes;            /* Bytes requested */
+	uint64_t      nblocks;          /* Number of blocks */
+	uint64_t      reserved;         /* Bytes held in blocks */
+	uint64_t      peak;             /* Most bytes ever held in blocks */
+};
+
 /** Allocate a block of memory (set all memory to 0) **/
 void * xmalloc(size_t);
 
 /** Allocate a block of aligned memory (nothing is set) **/
 void * xmemalign(size_t);
 
+/** Resize a block of memory (new memory is not set) **/
+void * xrealloc(void *, size_t);
+
+/** Initialise an arena **/
+void arena_init(struct arena *, size_t);
+
+/** Allocate from an arena (nothing is set) **/
+void * arena_alloc(struct arena *, size_t);
+
+/** Print the allocation statistics of an arena **/
+void arena_stats(const struct arena *, const char *);
+
+/** Release all the memory of an arena **/
+void arena_free(struct arena *);
+
 #ifdef __cplusplus
 }                               /* extern "C" */
 #endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file mkevents.c
+ * Generate the perfect hash of the MOAB record types.
+ *
+ * Run at build time, this writes events_hash.h to stdout. It searches
+ * for the smallest power of two table, and a seed for event_hash(),
+ * that give every record type in EVENTS_TABLE a slot of its own. A
+ * record type is then dispatched with one hash and one compare.
+ *
+ * \ingroup MOAB
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <err.h>
+
+#include "config.h"
+#include "events.h"
+
+/** Largest table tried **/
+#define MK_SIZE_MAX     4096
+
+/** Seeds tried for each table size **/
+#define MK_SEEDS        (1 << 16)
+
+/** The record types **/
+static const char *const names[EVENT_TYPES] = {
+	EVENTS_TABLE(X_NAME)
+};
+
+/**
+ * Try to place every record type in a table.
+ *
+ * @param[in]  size      The table size, a power of 2.
+ * @param[in]  seed      The hash seed.
+ * @param[out] slots     The record type of each slot, -1 if empty.
+ * @retval     0         If no two record types share a slot
+ * @retval     1         If they do
+ **/
+static int32_t
+mk_place(uint32_t size,
+	 uint32_t seed,
+	 int16_t *slots)
+{
+	int32_t i = 0;
+	uint32_t h = 0;
+
+	for (h = 0; h < size; ++h) {
+		slots[h] = -1;
+	}
+	for (i = 0; i < EVENT_TYPES; ++i) {
+		h = event_hash(names[i], strlen(names[i]), seed) & (size - 1);
+		if (slots[h] != -1) {
+			return(EXIT_FAILURE);
+		}
+		slots[h] = i;
+	}
+	return(EXIT_SUCCESS);
+}
+
+int
+main(void)
+{
+	uint32_t i    = 0;
+	uint32_t size = 0;
+	uint32_t seed = 0;
+	int16_t slots[MK_SIZE_MAX];
+
+	for (size = 1; size < 2 * EVENT_TYPES; size *= 2) {
+		;
+	}
+	for (; size <= MK_SIZE_MAX; size *= 2) {
+		for (seed = 2166136261u; seed < 2166136261u + MK_SEEDS; ++seed) {
+			if (mk_place(size, seed, slots) == 0) {
+				goto found;
+			}
+		}
+	}
+	errx(EXIT_FAILURE, "no perfect hash of %d record types", EVENT_TYPES);
+
+found:
+	printf("/* Generated by mkevents from EVENTS_TABLE, do not edit */\n\n"
+	       "/** Seed of event_hash() **/\n"
+	       "#define EVENT_HASH_SEED %#xu\n\n"
+	       "/** Number of slots, a power of 2 **/\n"
+	       "#define EVENT_HASH_SIZE %u\n\n"
+	       "/** Record type in each slot, -1 if empty **/\n"
+	       "static const int16_t event_slots[EVENT_HASH_SIZE] = {",
+	       seed, size);
+	for (i = 0; i < size; ++i) {
+		printf("%s%3d%s", i % 16 ? "" : "\n\t", slots[i],
+		       i + 1 < size ? "," : "\n");
+	}
+	printf("};\n");
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * \}
+ **/
@@ -39,6 +39,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <err.h>
 #include <sysexits.h>
 #include <string.h>
@@ -50,33 +51,37 @@
 #include "events.h"
 #include "projects.h"
 
+static void project_free_events(struct project *);
+
 /**
  * Read reservation names from a generated reservation
  * configuration file.
  *
  * \param[in] filename     The name of the reservation file.
  * \param[out] projects    An array of reservation structures.
- * \param[out] n           The number of reservations.
+ * \param[in,out] a        The arena to allocate the projects from.
  * \retval 0               If there file was read successfully.
  * \retval 1               If there was an error reading the file.
  **/
 int32_t
 project_rsv(const char *filename,
-	    struct project **projects)
+	    struct project **projects,
+	    struct arena *a)
 {
 	static const char r[] = "### Reservation ([A-Za-z0-9-]+)-([0-9]{2})z";
 
 	int32_t ierr        = 0;            /* Error number */
 	int32_t rlen        = 0;            /* Regex error & match length */
-	int32_t seen        = 0;            /* Flag to set if duplicate name */
 	FILE *ifp           = NULL;         /* Input file pointer */
 	char line[LINE_MAX];                /* Read line from file */
 	char *rstr          = NULL;         /* Regex error string */
 	regex_t rq          = {0};          /* Compiled regex query */
 	regmatch_t rm[3]    = {0};          /* Regex match positions array */
 	struct project *p   = NULL;
+	struct pindex idx   = {0};          /* Projects seen so far */
 
 	memset(line, 0, LINE_MAX * sizeof(char));
+	project_index(*projects, &idx);
 
 	if ((ierr = regcomp(&rq, r, REG_EXTENDED)) != 0) {
 		rlen = regerror(ierr, &rq, NULL, 0);
@@ -88,32 +93,32 @@ project_rsv(const char *filename,
 
 	if ((ifp = fopen(filename, "r")) == NULL) {
 		warn("unable to open reservation file %s", filename);
+		ierr = EXIT_FAILURE;
 		goto rtn_err;
 	}
 
 	while (fgets(line, LINE_MAX, ifp) != NULL) {
 		if (regexec(&rq, &line[0], 3, rm, 0) == 0) {
 			rlen = (rm[1].rm_eo - rm[1].rm_so +1);
-			seen = 0;
-			p = *projects;
-			while (p != NULL) {
-				if (strncmp(p->name,
-					    line + rm[1].rm_so, rlen -1) == 0) {
-					p->epochs[p->nepochs] = strtoul(line +rm[2].rm_so, NULL, 10);
-					p->nepochs += 1;
-					seen = 1;
+			p = project_find(&idx, line + rm[1].rm_so, rlen -1);
+			if (p != NULL) {
+				if (p->nepochs == MAX_EPOCHS) {
+					warnx("too many epochs for %s", p->name);
+					continue;
 				}
-				p = p->next;
-			}
-			if (!seen) {
-				rlen *= sizeof(char);
-				p = xmalloc(sizeof(struct project));
-				p->name = xmalloc(rlen *sizeof(char));
-				strncpy(p->name, line + rm[1].rm_so, rlen -1);
+				p->epochs[p->nepochs] = strtoul(line +rm[2].rm_so, NULL, 10);
+				p->nepochs += 1;
+			} else {
+				p = arena_alloc(a, sizeof(struct project));
+				memset(p, 0, sizeof(struct project));
+				p->name = arena_alloc(a, rlen * sizeof(char));
+				memcpy(p->name, line + rm[1].rm_so, rlen -1);
+				p->name[rlen -1] = '\0';
 				p->nepochs = 1;
 				p->epochs[0] = strtoul(line +rm[2].rm_so, NULL, 10);
 				p->next = *projects;
 				*projects = p;
+				project_index_add(&idx, p);
 			}
 		}
 	}
@@ -121,6 +126,7 @@ project_rsv(const char *filename,
 
 rtn_err:
 	regfree(&rq);
+	project_index_free(&idx);
 	if (rstr) {
 		free(rstr);
 		rstr = NULL;
@@ -131,6 +137,438 @@ rtn_err:
 	}
 	return(ierr);
 }
+
+/**
+ * Keep a single project of a list.
+ *
+ * The other projects are unlinked, their memory belongs to the arena.
+ *
+ * \param[in,out] projects The list of projects.
+ * \param[in] name         The name of the project to keep.
+ * \retval 0               If the project was found.
+ * \retval 1               If there is no such project.
+ **/
+int32_t
+project_select(struct project **projects,
+	       const char *name)
+{
+	struct project *p = NULL;
+
+	for (p = *projects; p != NULL; p = p->next) {
+		if (strcmp(p->name, name) == 0) {
+			p->next = NULL;
+			*projects = p;
+			return(EXIT_SUCCESS);
+		}
+	}
+
+	warnx("reservation %s not found", name);
+	return(EXIT_FAILURE);
+}
+
+/**
+ * Hash a project name (64 bit FNV-1a).
+ *
+ * \param[in] name         The name.
+ * \param[in] n            The length of the name.
+ * \return                 The hash of the name.
+ **/
+static uint64_t
+project_hash(const char *name,
+	     size_t n)
+{
+	size_t i   = 0;
+	uint64_t h = 14695981039346656037ULL;
+
+	for (i = 0; i < n; ++i) {
+		h ^= (unsigned char)name[i];
+		h *= 1099511628211ULL;
+	}
+	return(h);
+}
+
+/**
+ * Insert a project into the slots of an index.
+ *
+ * \param[in,out] idx      The index, which must have a free slot.
+ * \param[in] p            The project to insert.
+ **/
+static void
+project_index_put(struct pindex *idx,
+		  struct project *p)
+{
+	size_t i    = 0;
+	size_t mask = idx->size - 1;
+
+	i = project_hash(p->name, strlen(p->name)) & mask;
+	while (idx->slots[i] != NULL) {
+		i = (i + 1) & mask;
+	}
+	idx->slots[i] = p;
+	idx->n += 1;
+}
+
+/**
+ * Add a project to an index.
+ *
+ * The index is kept at most half full, doubling as needed.
+ *
+ * \param[in,out] idx      The index.
+ * \param[in] p            The project to add.
+ * \retval 0               If the project was added.
+ **/
+int32_t
+project_index_add(struct pindex *idx,
+		  struct project *p)
+{
+	size_t i               = 0;
+	size_t size            = 0;
+	struct project **slots = NULL;
+
+	if ((idx->n + 1) * 2 > idx->size) {
+		size  = idx->size;
+		slots = idx->slots;
+		idx->size  = size ? size * 2 : 64;
+		idx->slots = xmalloc(idx->size * sizeof(struct project *));
+		idx->n     = 0;
+		for (i = 0; i < size; ++i) {
+			if (slots[i]) {
+				project_index_put(idx, slots[i]);
+			}
+		}
+		free(slots);
+	}
+	project_index_put(idx, p);
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Build an index of a list of projects, keyed by name.
+ *
+ * \param[in] projects     The list of projects.
+ * \param[out] idx         The index.
+ * \retval 0               If the index was built.
+ **/
+int32_t
+project_index(struct project *projects,
+	      struct pindex *idx)
+{
+	memset(idx, 0, sizeof(struct pindex));
+	while (projects != NULL) {
+		project_index_add(idx, projects);
+		projects = projects->next;
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Find a project by name.
+ *
+ * \param[in] idx          The index.
+ * \param[in] name         The name, need not be NUL terminated.
+ * \param[in] n            The length of the name.
+ * \return                 The project, or NULL if there is none.
+ **/
+struct project *
+project_find(const struct pindex *idx,
+	     const char *name,
+	     size_t n)
+{
+	size_t i          = 0;
+	size_t mask       = 0;
+	struct project *p = NULL;
+
+	if (idx->size == 0) {
+		return(NULL);
+	}
+
+	mask = idx->size - 1;
+	i = project_hash(name, n) & mask;
+	while ((p = idx->slots[i]) != NULL) {
+		if (strncmp(p->name, name, n) == 0 && p->name[n] == '\0') {
+			return(p);
+		}
+		i = (i + 1) & mask;
+	}
+
+	return(NULL);
+}
+
+/**
+ * Free an index (but not the projects in it).
+ *
+ * \param[in,out] idx      The index.
+ **/
+void
+project_index_free(struct pindex *idx)
+{
+	if (idx->slots) {
+		free(idx->slots);
+	}
+	memset(idx, 0, sizeof(struct pindex));
+}
+
+/**
+ * Hash a reservation end time.
+ *
+ * \param[in] end          The end time.
+ * \param[in] mask         The number of slots less one.
+ * \return                 The first slot to probe.
+ **/
+static size_t
+project_rsv_hash(time_t end,
+		 size_t mask)
+{
+	return(((uint64_t)end * 11400714819323198485ULL >> 32) & mask);
+}
+
+/**
+ * Find the reservation of a project with a given end time.
+ *
+ * \param[in] p            The project.
+ * \param[in] end          The end time.
+ * \return                 The reservation row, or -1 if there is none.
+ **/
+static int64_t
+project_rsv_find(const struct project *p,
+		 time_t end)
+{
+	size_t i    = 0;
+	size_t mask = 0;
+	int64_t row = 0;
+
+	if (p->rindex.size == 0) {
+		return(-1);
+	}
+
+	mask = p->rindex.size - 1;
+	i = project_rsv_hash(end, mask);
+	while ((row = p->rindex.slots[i]) != 0) {
+		if (p->reservations.ends[row - 1] == end) {
+			return(row - 1);
+		}
+		i = (i + 1) & mask;
+	}
+
+	return(-1);
+}
+
+/**
+ * Add a reservation to the end time index of a project.
+ *
+ * The index is kept at most half full, doubling as needed.
+ *
+ * \param[in,out] p        The project.
+ * \param[in] row          The reservation row, whose end time is not
+ *                         indexed.
+ **/
+static void
+project_rsv_index(struct project *p,
+		  int64_t row)
+{
+	size_t i       = 0;
+	size_t j       = 0;
+	size_t size    = 0;
+	size_t mask    = 0;
+	int64_t *slots = NULL;
+	const int64_t *ends = p->reservations.ends;
+
+	if ((p->rindex.n + 1) * 2 > p->rindex.size) {
+		size  = p->rindex.size;
+		slots = p->rindex.slots;
+		p->rindex.size  = size ? size * 2 : 16;
+		p->rindex.slots = xmalloc(p->rindex.size * sizeof(int64_t));
+		mask = p->rindex.size - 1;
+		for (i = 0; i < size; ++i) {
+			if (slots[i]) {
+				j = project_rsv_hash(ends[slots[i] - 1], mask);
+				while (p->rindex.slots[j] != 0) {
+					j = (j + 1) & mask;
+				}
+				p->rindex.slots[j] = slots[i];
+			}
+		}
+		free(slots);
+	}
+
+	mask = p->rindex.size - 1;
+	i = project_rsv_hash(ends[row], mask);
+	while (p->rindex.slots[i] != 0) {
+		i = (i + 1) & mask;
+	}
+	p->rindex.slots[i] = row + 1;
+	p->rindex.n += 1;
+}
+
+/**
+ * Add a reservation to a project.
+ *
+ * MOAB creates a reservation even if all nodes are not avaliable.
+ * It will then recreate the reservation when more nodes are added.
+ * So if the project already has a reservation with the same end
+ * time it is updated. The reservations are indexed by end time so
+ * this is a constant time lookup. Otherwise the event is appended.
+ *
+ * \param[in,out] p        The project.
+ * \param[in] res          The reservation event.
+ * \retval 0               If the reservation was added.
+ * \retval 1               If an existing reservation was updated.
+ **/
+int32_t
+project_add_rsv(struct project *p,
+		const struct event *res)
+{
+	int64_t row = 0;
+
+	if ((row = project_rsv_find(p, res->end)) >= 0) {
+		p->reservations.starts[row] = res->start;
+		p->reservations.nodes[row]  = res->nodes;
+		return(1);
+	}
+
+	row = columns_append(&p->reservations, res);
+	project_rsv_index(p, row);
+
+	return(0);
+}
+
+/**
+ * Copy a list of projects without any of their events.
+ *
+ * The copy keeps the order of the original list.
+ *
+ * \param[in] src          The list of projects to copy.
+ * \param[out] dst         The new list of projects.
+ * \param[in,out] a        The arena to allocate the copy from.
+ * \retval 0               If the list was copied.
+ **/
+int32_t
+project_clone(const struct project *src,
+	      struct project **dst,
+	      struct arena *a)
+{
+	size_t n              = 0;
+	struct project *p     = NULL;
+	struct project **tail = dst;
+
+	*dst = NULL;
+	while (src != NULL) {
+		n = strlen(src->name) + 1;
+		p = arena_alloc(a, sizeof(struct project));
+		memset(p, 0, sizeof(struct project));
+		p->name = arena_alloc(a, n * sizeof(char));
+		memcpy(p->name, src->name, n);
+		p->nepochs = src->nepochs;
+		memcpy(p->epochs, src->epochs, sizeof(p->epochs));
+		*tail = p;
+		tail = &(p->next);
+		src = src->next;
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Move the events of a cloned list of projects into the original.
+ *
+ * The events of src are taken to have happened after those already in
+ * dst, so reservations in src may update reservations in dst. After
+ * the merge src holds no events.
+ *
+ * \param[in,out] dst      The list of projects to merge into.
+ * \param[in,out] src      A list created by project_clone() from dst.
+ * \retval 0               If the lists were merged.
+ * \retval 1               If the lists do not match.
+ **/
+int32_t
+project_merge(struct project *dst,
+	      struct project *src)
+{
+	int64_t i          = 0;
+	struct event e     = {0};
+
+	while (dst != NULL && src != NULL) {
+		if (strcmp(dst->name, src->name) != 0) {
+			warnx("unable to merge project %s with %s",
+			      dst->name, src->name);
+			return(EXIT_FAILURE);
+		}
+
+		columns_concat(&dst->jobs, &src->jobs);
+
+		/* Reservations are reconciled oldest first */
+		for (i = 0; i < src->reservations.n; ++i) {
+			columns_get(&src->reservations, i, &e);
+			project_add_rsv(dst, &e);
+		}
+
+		project_free_events(src);
+		dst = dst->next;
+		src = src->next;
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Print the number of events held by a list of projects.
+ *
+ * \param[in] p            The first project in the list.
+ **/
+void
+project_stats(const struct project *p)
+{
+	int64_t nr    = 0;
+	int64_t nj    = 0;
+	int64_t bytes = 0;
+	const int64_t rsize = sizeof(uint8_t) + 4 * sizeof(int64_t);
+
+	while (p != NULL) {
+		nr    += p->reservations.n;
+		nj    += p->jobs.n;
+		bytes += (p->reservations.cap + p->jobs.cap) * rsize;
+		bytes += p->rindex.size * sizeof(int64_t);
+		p = p->next;
+	}
+	printf("Columns: %" PRId64 " reservations, %" PRId64 " jobs, "
+	       "%" PRId64 " bytes\n", nr, nj, bytes);
+}
+
+/**
+ * Free the events of a project.
+ *
+ * \param[in,out] p        The project.
+ **/
+static void
+project_free_events(struct project *p)
+{
+	columns_free(&p->reservations);
+	columns_free(&p->jobs);
+	if (p->rindex.slots) {
+		free(p->rindex.slots);
+	}
+	memset(&p->rindex, 0, sizeof(struct rindex));
+}
+
+/**
+ * Free the events of a list of projects.
+ *
+ * The projects themselves are owned by the arena they were allocated
+ * from and are released with it.
+ *
+ * \param[in] p            The first project in the list.
+ **/
+void
+project_free(struct project *p)
+{
+	while (p != NULL) {
+		project_free_events(p);
+		p = p->next;
+	}
+}
+
 /**
  * \}
  **/
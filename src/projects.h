@@ -48,20 +48,63 @@ extern "C"
 /** Maximum number of epochs **/
 #define MAX_EPOCHS               24
 
+/** Open addressing hash index of reservations, keyed by end time **/
+struct rindex {
+	size_t       size;              /* Number of slots (a power of 2) */
+	size_t       n;                 /* Number of reservations */
+	int64_t      *slots;            /* Reservation row + 1, 0 if empty */
+};
+
 /** Linked list structure for a project **/
 struct project {
 	uint8_t      nepochs;
 	uint8_t      epochs[MAX_EPOCHS];
-	int64_t      nr;
-	int64_t      nj;
 	char         *name;
-	struct event *reservations;
-	struct event *jobs;
+	struct columns reservations;
+	struct columns jobs;
+	struct rindex rindex;
 	struct project *next;
 };
 
+/** Open addressing hash index of projects, keyed by name **/
+struct pindex {
+	size_t         size;            /* Number of slots (a power of 2) */
+	size_t         n;               /* Number of projects */
+	struct project **slots;
+};
+
 /** Parse a reservation file to get all the reservations**/
-int32_t project_rsv(const char *, struct project **);
+int32_t project_rsv(const char *, struct project **, struct arena *);
+
+/** Keep a single project of a list **/
+int32_t project_select(struct project **, const char *);
+
+/** Build an index of a list of projects **/
+int32_t project_index(struct project *, struct pindex *);
+
+/** Add a project to an index **/
+int32_t project_index_add(struct pindex *, struct project *);
+
+/** Find a project by name **/
+struct project *project_find(const struct pindex *, const char *, size_t);
+
+/** Free an index **/
+void project_index_free(struct pindex *);
+
+/** Add a reservation to a project, or update an existing one **/
+int32_t project_add_rsv(struct project *, const struct event *);
+
+/** Copy the names and epochs of a list of projects **/
+int32_t project_clone(const struct project *, struct project **, struct arena *);
+
+/** Move all the events of a cloned list into the original **/
+int32_t project_merge(struct project *, struct project *);
+
+/** Print the number of events held by a list of projects **/
+void project_stats(const struct project *);
+
+/** Free the events of a list of projects (the projects belong to their arena) **/
+void project_free(struct project *);
 
 #ifdef __cplusplus
 }                               /* extern "C" */
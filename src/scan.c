@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file scan.c
+ * Scanning routines for event log lines.
+ *
+ * The event log lines are not NUL terminated, so every routine takes
+ * the length of the line and never reads past it. Where the processor
+ * supports them the SSE4.2 string instructions are used for key search,
+ * and SSE2 or AVX2 compares to split a line into its fields, otherwise
+ * a scalar version is used. The choice is made once at run time.
+ *
+ * \ingroup scan
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <nmmintrin.h>
+#  include <immintrin.h>
+#  define SCAN_SSE42    1
+#  define SCAN_AVX2     1
+#endif
+
+/** Function pointer definition for a key search **/
+typedef const char *(*scan_find_fp)(const char *restrict, size_t,
+				    const char *restrict, size_t);
+
+/** Function pointer definition for splitting a line into fields **/
+typedef int32_t (*scan_tokens_fp)(const char *restrict, size_t,
+				  struct tokens *);
+
+static const char *scan_find_init(const char *restrict, size_t,
+				  const char *restrict, size_t);
+static int32_t scan_tokens_init(const char *restrict, size_t,
+				struct tokens *);
+
+/** The key search in use, chosen on the first call **/
+static scan_find_fp scan_find_impl = scan_find_init;
+
+/** The field splitter in use, chosen on the first call **/
+static scan_tokens_fp scan_tokens_impl = scan_tokens_init;
+
+/** Where a field splitter is within a line **/
+struct tokenizer {
+	uint32_t word;                  /* Start of the current field */
+	struct tokens *tk;              /* The table being filled */
+};
+
+/**
+ * Find the first occurrence of a key within a line (scalar version).
+ *
+ * \param[in] s    The line to search.
+ * \param[in] n    The length of the line.
+ * \param[in] k    The key to search for.
+ * \param[in] nk   The length of the key.
+ * \return         A pointer to the key within the line, or NULL.
+ **/
+static const char *
+scan_find_scalar(const char *restrict s,
+		 size_t n,
+		 const char *restrict k,
+		 size_t nk)
+{
+	return(memmem(s, n, k, nk));
+}
+
+#ifdef SCAN_SSE42
+/**
+ * Find the first occurrence of a key within a line (SSE4.2 version).
+ *
+ * Each 16 byte block of the line is searched for the key with an
+ * ordered compare, this reports where a whole key starts, or where a
+ * key starts that runs off the end of the block. Such a candidate is
+ * then checked in full with an equal-each compare. Keys longer than
+ * 16 bytes, and the last partial block of the line, use the scalar
+ * version.
+ *
+ * \param[in] s    The line to search.
+ * \param[in] n    The length of the line.
+ * \param[in] k    The key to search for.
+ * \param[in] nk   The length of the key.
+ * \return         A pointer to the key within the line, or NULL.
+ **/
+__attribute__((__target__("sse4.2")))
+static const char *
+scan_find_sse42(const char *restrict s,
+		size_t n,
+		const char *restrict k,
+		size_t nk)
+{
+	int idx         = 0;
+	const char *p   = s;
+	const char *end = s + n;
+	__m128i key     = {0};
+	__m128i blk     = {0};
+	char kbuf[16]   = {0};
+
+	if (nk == 0 || nk > 16) {
+		return(scan_find_scalar(s, n, k, nk));
+	}
+	memcpy(kbuf, k, nk);
+	key = _mm_loadu_si128((const __m128i *)kbuf);
+
+	while (p + 16 <= end) {
+		blk = _mm_loadu_si128((const __m128i *)p);
+		idx = _mm_cmpestri(key, nk, blk, 16, V_STRFIND);
+		if (idx == 16) {
+			p += 16;
+			continue;
+		}
+		if (idx + nk <= 16) {
+			return(p + idx);
+		}
+		/* The candidate runs off the end of the block */
+		p += idx;
+		if (p + 16 > end) {
+			break;
+		}
+		blk = _mm_loadu_si128((const __m128i *)p);
+		if ((size_t)_mm_cmpestri(key, nk, blk, nk, V_STRCMP) == nk) {
+			return(p);
+		}
+		++p;
+	}
+
+	return(scan_find_scalar(p, end - p, k, nk));
+}
+#endif
+
+/**
+ * Choose the key search for this processor, then run it.
+ **/
+static const char *
+scan_find_init(const char *restrict s,
+	       size_t n,
+	       const char *restrict k,
+	       size_t nk)
+{
+	scan_find_fp fp = scan_find_scalar;
+
+#ifdef SCAN_SSE42
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		fp = scan_find_sse42;
+	}
+#endif
+	__atomic_store_n(&scan_find_impl, fp, __ATOMIC_RELAXED);
+
+	return(fp(s, n, k, nk));
+}
+
+/**
+ * Find the first occurrence of a key within a line.
+ *
+ * \param[in] s    The line to search.
+ * \param[in] n    The length of the line.
+ * \param[in] k    The key to search for.
+ * \param[in] nk   The length of the key.
+ * \return         A pointer to the key within the line, or NULL.
+ **/
+const char *
+scan_find(const char *restrict s,
+	  size_t n,
+	  const char *restrict k,
+	  size_t nk)
+{
+	return(__atomic_load_n(&scan_find_impl, __ATOMIC_RELAXED)(s, n, k, nk));
+}
+
+/**
+ * End the current field of a line at a space.
+ *
+ * Runs of spaces are common, so the entry is always written and only
+ * kept when the field is not empty.
+ *
+ * \param[in,out] t  The field splitter.
+ * \param[in] p      The offset of the space.
+ * \retval 0         If there is room for more fields.
+ * \retval 1         If the table is full.
+ **/
+static inline int32_t
+scan_field(struct tokenizer *t,
+	   uint32_t p)
+{
+	struct token *f = &t->tk->t[t->tk->n];
+
+	f->off = t->word;
+	f->len = p - t->word;
+	t->tk->n += (p > t->word);
+	t->word = p + 1;
+
+	return(t->tk->n == SCAN_TOKENS);
+}
+
+/**
+ * Handle a space or newline found within a line.
+ *
+ * \param[in,out] t  The field splitter.
+ * \param[in] line   The line.
+ * \param[in] p      The offset of the character.
+ * \retval 0         To carry on splitting the line.
+ * \retval 1         If the line, or the table, is done.
+ **/
+static inline int32_t
+scan_delim(struct tokenizer *t,
+	   const char *restrict line,
+	   uint32_t p)
+{
+	if (scan_field(t, p)) {
+		return(1);
+	}
+	return(line[p] == '\n');
+}
+
+/**
+ * Split a line into its fields (scalar version).
+ *
+ * \param[in] line   The line.
+ * \param[in] n      The length of the line.
+ * \param[out] tk    The token table.
+ * \return           The number of fields.
+ **/
+static int32_t
+scan_tokens_scalar(const char *restrict line,
+		   size_t n,
+		   struct tokens *tk)
+{
+	uint32_t p         = 0;
+	struct tokenizer t = {0, tk};
+
+	tk->n = 0;
+	for (p = 0; p < n; ++p) {
+		if ((line[p] == ' ' || line[p] == '\n') &&
+		    scan_delim(&t, line, p)) {
+			return(tk->n);
+		}
+	}
+	scan_field(&t, n);
+
+	return(tk->n);
+}
+
+#ifdef SCAN_SSE42
+/**
+ * Split a line into its fields (SSE2 version).
+ *
+ * Each 16 byte block is compared against space and newline at once,
+ * and only the bytes that matched are looked at.
+ *
+ * \param[in] line   The line.
+ * \param[in] n      The length of the line.
+ * \param[out] tk    The token table.
+ * \return           The number of fields.
+ **/
+__attribute__((__target__("sse2")))
+static int32_t
+scan_tokens_sse2(const char *restrict line,
+		 size_t n,
+		 struct tokens *tk)
+{
+	uint32_t p         = 0;
+	uint32_t mask      = 0;
+	struct tokenizer t = {0, tk};
+	const __m128i sp   = _mm_set1_epi8(' ');
+	const __m128i nl   = _mm_set1_epi8('\n');
+	__m128i blk        = {0};
+
+	tk->n = 0;
+	for (p = 0; p + 16 <= n; p += 16) {
+		blk  = _mm_loadu_si128((const __m128i *)(line + p));
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(blk, sp),
+						      _mm_cmpeq_epi8(blk, nl)));
+		while (mask) {
+			if (scan_delim(&t, line, p + __builtin_ctz(mask))) {
+				return(tk->n);
+			}
+			mask &= mask - 1;
+		}
+	}
+	for (; p < n; ++p) {
+		if ((line[p] == ' ' || line[p] == '\n') &&
+		    scan_delim(&t, line, p)) {
+			return(tk->n);
+		}
+	}
+	scan_field(&t, n);
+
+	return(tk->n);
+}
+#endif
+
+#ifdef SCAN_AVX2
+/**
+ * Split a line into its fields (AVX2 version).
+ *
+ * As the SSE2 version, with 32 byte blocks.
+ *
+ * \param[in] line   The line.
+ * \param[in] n      The length of the line.
+ * \param[out] tk    The token table.
+ * \return           The number of fields.
+ **/
+__attribute__((__target__("avx2")))
+static int32_t
+scan_tokens_avx2(const char *restrict line,
+		 size_t n,
+		 struct tokens *tk)
+{
+	uint32_t p         = 0;
+	uint32_t mask      = 0;
+	struct tokenizer t = {0, tk};
+	const __m256i sp   = _mm256_set1_epi8(' ');
+	const __m256i nl   = _mm256_set1_epi8('\n');
+	__m256i blk        = {0};
+
+	tk->n = 0;
+	for (p = 0; p + 32 <= n; p += 32) {
+		blk  = _mm256_loadu_si256((const __m256i *)(line + p));
+		mask = _mm256_movemask_epi8(
+				_mm256_or_si256(_mm256_cmpeq_epi8(blk, sp),
+						_mm256_cmpeq_epi8(blk, nl)));
+		while (mask) {
+			if (scan_delim(&t, line, p + __builtin_ctz(mask))) {
+				return(tk->n);
+			}
+			mask &= mask - 1;
+		}
+	}
+	for (; p < n; ++p) {
+		if ((line[p] == ' ' || line[p] == '\n') &&
+		    scan_delim(&t, line, p)) {
+			return(tk->n);
+		}
+	}
+	scan_field(&t, n);
+
+	return(tk->n);
+}
+#endif
+
+/**
+ * Choose the field splitter for this processor, then run it.
+ **/
+static int32_t
+scan_tokens_init(const char *restrict line,
+		 size_t n,
+		 struct tokens *tk)
+{
+	scan_tokens_fp fp = scan_tokens_scalar;
+
+#ifdef SCAN_SSE42
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		fp = scan_tokens_sse2;
+	}
+#endif
+#ifdef SCAN_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		fp = scan_tokens_avx2;
+	}
+#endif
+	__atomic_store_n(&scan_tokens_impl, fp, __ATOMIC_RELAXED);
+
+	return(fp(line, n, tk));
+}
+
+/**
+ * Split a line into its fields.
+ *
+ * Fields are separated by spaces and the line ends at a newline or
+ * after n bytes. Fields past SCAN_TOKENS are not recorded.
+ *
+ * \param[in] line   The line.
+ * \param[in] n      The length of the line.
+ * \param[out] tk    The token table.
+ * \return           The number of fields.
+ **/
+int32_t
+scan_tokens(const char *restrict line,
+	    size_t n,
+	    struct tokens *tk)
+{
+	return(__atomic_load_n(&scan_tokens_impl, __ATOMIC_RELAXED)(line, n, tk));
+}
+
+/**
+ * Find the value of a KEY=VALUE field in a token table.
+ *
+ * \param[in] tk     The token table of the line.
+ * \param[in] line   The line.
+ * \param[in] k      The key of the field.
+ * \param[in] nk     The length of the key.
+ * \param[out] nval  The length of the value.
+ * \return           A pointer to the value within the line, or NULL.
+ **/
+const char *
+scan_value(const struct tokens *tk,
+	   const char *restrict line,
+	   const char *restrict k,
+	   size_t nk,
+	   size_t *nval)
+{
+	int32_t i             = 0;
+	const char *f         = NULL;
+	const struct token *t = NULL;
+
+	for (i = 0; i < tk->n; ++i) {
+		t = &tk->t[i];
+		f = line + t->off;
+		if (t->len > nk && f[nk] == '=' && f[0] == k[0] &&
+		    memcmp(f, k, nk) == 0) {
+			*nval = t->len - nk - 1;
+			return(f + nk + 1);
+		}
+	}
+
+	return(NULL);
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/** Eight ASCII digits can be converted at once **/
+#  define SCAN_SWAR     1
+#endif
+
+#ifdef SCAN_SWAR
+/**
+ * Count the leading digits of eight bytes (SWAR).
+ *
+ * With '0' taken from every byte, a digit is left below 10 and any
+ * other byte either has its top bit set, or gains it when 0x76 is
+ * added. Borrows and carries only run towards later bytes, so they
+ * can not hide the first byte that is not a digit.
+ *
+ * \param[in] v      Eight bytes, the first in the low byte.
+ * \return           The number of leading digits, 0 to 8.
+ **/
+static inline int32_t
+scan_swar_count(uint64_t v)
+{
+	uint64_t x = v - 0x3030303030303030ULL;
+	uint64_t m = (x | (x + 0x7676767676767676ULL)) &
+		     0x8080808080808080ULL;
+
+	return(m ? __builtin_ctzll(m) / 8 : 8);
+}
+
+/**
+ * Convert the leading digits of eight bytes to their value (SWAR).
+ *
+ * The digits are moved to the top of the word, behind zeros, which
+ * drops the bytes after them. Neighbouring digits are then combined
+ * into pairs, the pairs into fours and the fours into eight, with
+ * three multiplies in all.
+ *
+ * \param[in] v      Eight bytes, the first in the low byte.
+ * \param[in] c      The number of leading digits, 1 to 8.
+ * \return           Their value.
+ **/
+static inline uint64_t
+scan_swar_value(uint64_t v,
+		int32_t c)
+{
+	v -= 0x3030303030303030ULL;
+	v <<= (8 - c) * 8;
+	v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFULL;
+	v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFFULL;
+	v = (v * 10000 + (v >> 32)) & 0x00000000FFFFFFFFULL;
+
+	return(v);
+}
+#endif
+
+/**
+ * Parse a decimal integer field.
+ *
+ * The field ends at the first byte that is not a digit. Fields of up
+ * to eight digits, with eight bytes of the line left to load, are
+ * converted without a loop, others a digit at a time.
+ *
+ * \param[in] p      The start of the field.
+ * \param[in] end    The end of the line.
+ * \param[out] v     The value.
+ * \retval 0         If the field was parsed.
+ * \retval 1         If it has no digits, or more than SCAN_DIGITS.
+ **/
+int32_t
+scan_int(const char *restrict p,
+	 const char *restrict end,
+	 int64_t *v)
+{
+	int32_t c  = 0;
+	int64_t r  = 0;
+#ifdef SCAN_SWAR
+	uint64_t w = 0;
+
+	if (end - p >= 8) {
+		memcpy(&w, p, 8);
+		c = scan_swar_count(w);
+		if (c == 0) {
+			return(EXIT_FAILURE);
+		}
+		if (c < 8 || end - p == 8 || (unsigned)(p[8] - '0') > 9) {
+			*v = scan_swar_value(w, c);
+			return(EXIT_SUCCESS);
+		}
+	}
+#endif
+
+	for (c = 0; p < end && (unsigned)(*p - '0') <= 9; ++p, ++c) {
+		if (c == SCAN_DIGITS) {
+			return(EXIT_FAILURE);
+		}
+		r = r * 10 + (*p - '0');
+	}
+	if (c == 0) {
+		return(EXIT_FAILURE);
+	}
+	*v = r;
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Parse an epoch timestamp field.
+ *
+ * Timestamps since 2001 have ten digits, these are converted as eight
+ * digits and then two. Anything else is left to scan_int().
+ *
+ * \param[in] p      The start of the field.
+ * \param[in] end    The end of the line.
+ * \param[out] v     The value.
+ * \retval 0         If the field was parsed.
+ * \retval 1         If it has no digits, or more than SCAN_DIGITS.
+ **/
+int32_t
+scan_time(const char *restrict p,
+	  const char *restrict end,
+	  int64_t *v)
+{
+#ifdef SCAN_SWAR
+	uint64_t w = 0;
+
+	if (end - p >= 10) {
+		memcpy(&w, p, 8);
+		if (scan_swar_count(w) == 8                &&
+		    (unsigned)(p[8] - '0') <= 9            &&
+		    (unsigned)(p[9] - '0') <= 9            &&
+		    (end - p == 10 || (unsigned)(p[10] - '0') > 9)) {
+			*v = scan_swar_value(w, 8) * 100 +
+			     (p[8] - '0') * 10 + (p[9] - '0');
+			return(EXIT_SUCCESS);
+		}
+	}
+#endif
+
+	return(scan_int(p, end, v));
+}
+
+/**
+ * \}
+ **/
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file scan.h
+ * Scanning routines for event log lines.
+ *
+ * \ingroup scan
+ * \{
+ **/
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Ordered compare, finds where a key starts within a block **/
+#define V_STRFIND       _SIDD_UBYTE_OPS|_SIDD_CMP_EQUAL_ORDERED
+
+/** Equal each compare, reports the first byte that differs **/
+#define V_STRCMP        _SIDD_UBYTE_OPS|_SIDD_CMP_EQUAL_EACH|_SIDD_MASKED_NEGATIVE_POLARITY
+
+/** Find the first occurrence of a key within a line **/
+const char * scan_find(const char *restrict, size_t, const char *restrict, size_t);
+
+/** Most fields of a line held in a token table **/
+#define SCAN_TOKENS     256
+
+/** A field of a line, as an offset into the line **/
+struct token {
+	uint32_t off;                   /* Start of the field */
+	uint32_t len;                   /* Length of the field */
+};
+
+/** Token table of a line **/
+struct tokens {
+	int32_t n;                      /* Number of fields */
+	struct token t[SCAN_TOKENS];
+};
+
+/** Split a line into its fields **/
+int32_t scan_tokens(const char *restrict, size_t, struct tokens *);
+
+/** Find the value of a KEY=VALUE field in a token table **/
+const char * scan_value(const struct tokens *, const char *restrict,
+			const char *restrict, size_t, size_t *);
+
+/** Most digits of an integer field **/
+#define SCAN_DIGITS     18
+
+/** Parse a decimal integer field **/
+int32_t scan_int(const char *restrict, const char *restrict, int64_t *);
+
+/** Parse an epoch timestamp field **/
+int32_t scan_time(const char *restrict, const char *restrict, int64_t *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* SCAN_H */
+/**
+ * \}
+ **/
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2016 Timothy Brown
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file scan_test.c
+ * Check the RSVEND scanner gives the same fields as the regex it
+ * replaced, with both the SSE4.2 and the scalar key search, and that
+ * the integer fields are read as strtoll() reads them.
+ *
+ * The scanner and key search are static, so their sources are
+ * included rather than linked.
+ *
+ * \ingroup scan
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <regex.h>
+
+#include "events.c"
+#include "scan.c"
+
+/** Lines checked with each key search **/
+#define TEST_LINES      200000
+
+/** The regex event_rsv() used, with [A-Za-z] for its [A-za-z] **/
+static const char test_regex[] = "RSVEND.*"
+	"NAME=([A-Za-z0-9-]+)-([0-9]{2})z\\.([0-9]+).*"
+	"STARTTIME=([0-9]+).*"
+	"ENDTIME=([0-9]+).*"
+	"ALLOCTC=([0-9]+).*";
+
+/** Pieces random lines are built from **/
+static const char *const test_pieces[] = {
+	"RSVEND", "NAME=", "hfip", "-06z", ".12", "STARTTIME=", "ENDTIME=",
+	"ALLOCTC=", "123", "9", " ", "x", "-", "z", ".", "=",
+	"NAME=ab-1z.3 ", "RSVGROUP=a-06z"
+};
+
+/** Number of pieces **/
+#define TEST_PIECES     (sizeof(test_pieces) / sizeof(test_pieces[0]))
+
+/** Fields checked with each integer parser **/
+#define TEST_INTS       1000000
+
+/**
+ * Build a random line, either a well formed RSVEND record or a jumble
+ * of the pieces, with the odd byte changed.
+ *
+ * \param[in] i      The line number.
+ * \param[out] line  The line.
+ * \param[in] size   The size of the line buffer.
+ * \return           The length of the line.
+ **/
+static int
+test_line(int64_t i,
+	  char *line,
+	  size_t size)
+{
+	int j = 0;
+	int k = 0;
+	int n = 0;
+
+	if (i & 1) {
+		n = snprintf(line, size, "00:00 1:2 rsv a-06z.1 RSVEND a "
+			     "NAME=hf%s-%02dz.%d STARTTIME=%d ENDTIME=%d "
+			     "ALLOCTC=%d X=1", rand() % 3 ? "ip" : "-x",
+			     rand() % 100, rand() % 50, rand(), rand(),
+			     rand() % 100);
+	} else {
+		k = rand() % 20;
+		for (j = 0; j < k; ++j) {
+			n += snprintf(line + n, size - n, "%s",
+				      test_pieces[rand() % TEST_PIECES]);
+		}
+	}
+	if (n && rand() % 3 == 0) {
+		line[rand() % n] = " =.-z09AN"[rand() % 9];
+	}
+	line[n] = '\0';
+
+	return(n);
+}
+
+/**
+ * Check the scanner and key search over random lines.
+ *
+ * \param[in] rq     The compiled regex.
+ * \param[in] what   The key search in use, for messages.
+ * \return           The number of mismatches.
+ **/
+static int64_t
+test_run(regex_t *rq,
+	 const char *what)
+{
+	int64_t i       = 0;
+	int64_t bad     = 0;
+	int64_t matched = 0;
+	int n           = 0;
+	int a           = 0;
+	int b           = 0;
+	size_t off      = 0;
+	size_t nk       = 0;
+	const char *k   = NULL;
+	const char *p   = NULL;
+	char line[4096];
+	regmatch_t m[7];
+	struct rsvend r;
+
+	srand(7);
+	for (i = 0; i < TEST_LINES; ++i) {
+		n = test_line(i, line, sizeof(line));
+		memset(&r, 0, sizeof(struct rsvend));
+		a = regexec(rq, line, 7, m, 0) == 0;
+		/* Lines reach the scanner once found to be RSVEND records */
+		p = strstr(line, "RSVEND");
+		b = p && event_rsv_scan(p + 6, n - (p + 6 - line), &r) == 0;
+		if (a != b) {
+			fprintf(stderr, "%s: regex %d, scanner %d: %s\n",
+				what, a, b, line);
+			++bad;
+		} else if (a) {
+			++matched;
+			if ((size_t)(m[1].rm_eo - m[1].rm_so) != r.nname ||
+			    line + m[1].rm_so != r.name  ||
+			    line + m[2].rm_so != r.epoch ||
+			    line + m[3].rm_so != r.id    ||
+			    line + m[4].rm_so != r.start ||
+			    line + m[5].rm_so != r.end   ||
+			    line + m[6].rm_so != r.nodes) {
+				fprintf(stderr, "%s: fields differ: %s\n",
+					what, line);
+				++bad;
+			}
+		}
+
+		/* The key search on its own, from any offset */
+		k   = test_pieces[rand() % TEST_PIECES];
+		nk  = strlen(k);
+		off = rand() % (n + 1);
+		if (scan_find(line + off, n - off, k, nk) !=
+		    memmem(line + off, n - off, k, nk)) {
+			fprintf(stderr, "%s: finding %s differs: %s\n",
+				what, k, line + off);
+			++bad;
+		}
+	}
+	printf("%s: %" PRId64 " lines, %" PRId64 " matched, %" PRId64
+	       " mismatches\n", what, i, matched, bad);
+
+	return(bad);
+}
+
+/**
+ * Check an integer parser against strtoll() over random fields.
+ *
+ * A field is an optional sign or space, a run of up to 24 digits and
+ * then another byte, with the end of the line put anywhere in it.
+ * Only the digits before the end of the line may be read. Fields are
+ * unsigned, so one that does not start with a digit must be rejected,
+ * as must one with more than SCAN_DIGITS digits.
+ *
+ * \param[in] fp     The parser, scan_int() or scan_time().
+ * \param[in] what   The parser in use, for messages.
+ * \return           The number of mismatches.
+ **/
+static int64_t
+test_ints(int32_t (*fp)(const char *restrict, const char *restrict,
+			int64_t *),
+	  const char *what)
+{
+	int64_t i      = 0;
+	int64_t bad    = 0;
+	int64_t v      = 0;
+	long long want = 0;
+	int32_t r      = 0;
+	int32_t ok     = 0;
+	int n          = 0;
+	int k          = 0;
+	int len        = 0;
+	char *e        = NULL;
+	char line[64];
+	char field[64];
+
+	srand(18);
+	for (i = 0; i < TEST_INTS; ++i) {
+		n = 0;
+		if (rand() % 4 == 0) {
+			line[n++] = "+- x"[rand() % 4];
+		}
+		/* Mostly the ten digits of a timestamp */
+		k = (rand() % 2) ? 10 : rand() % 25;
+		while (k-- > 0) {
+			line[n++] = '0' + rand() % 10;
+		}
+		line[n++] = " =,/:\n"[rand() % 6];
+		len = rand() % (n + 1);
+
+		/* What strtoll() makes of the field, cut at the end */
+		memcpy(field, line, len);
+		field[len] = '\0';
+		errno = 0;
+		want = strtoll(field, &e, 10);
+		ok = len > 0 && isdigit((unsigned char)field[0]) &&
+		     e - field <= SCAN_DIGITS && errno == 0;
+
+		v = -1;
+		r = fp(line, line + len, &v);
+		if ((r == 0) != ok || (ok && v != want)) {
+			fprintf(stderr, "%s: %.*s gave %d %" PRId64
+				", strtoll %lld\n", what, len, line, r, v,
+				want);
+			++bad;
+		}
+	}
+	printf("%s: %" PRId64 " fields, %" PRId64 " mismatches\n", what, i,
+	       bad);
+
+	return(bad);
+}
+
+int
+main(void)
+{
+	int64_t bad = 0;
+	regex_t rq;
+
+	if (regcomp(&rq, test_regex, REG_EXTENDED|REG_NEWLINE) != 0) {
+		fprintf(stderr, "unable to compile the regex\n");
+		return(EXIT_FAILURE);
+	}
+
+	scan_find_impl = scan_find_scalar;
+	bad += test_run(&rq, "scalar");
+#ifdef SCAN_SSE42
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		scan_find_impl = scan_find_sse42;
+		bad += test_run(&rq, "sse4.2");
+	} else {
+		printf("sse4.2: not supported, skipped\n");
+	}
+#endif
+	regfree(&rq);
+
+	bad += test_ints(scan_int, "scan_int");
+	bad += test_ints(scan_time, "scan_time");
+
+	return(bad ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * \}
+ **/
@@ -0,0 +1,733 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file serve.c
+ * Answering queries on the events held in memory.
+ *
+ * The daemon parses the event logs once, then follows the current
+ * day's log as follow_run() does. It keeps every event in memory
+ * rather than writing it out. Queries are read from a Unix domain
+ * socket, one per line, and each is answered with a line of JSON:
+ *
+ *     projects                 The projects and how many events each has
+ *     stats                    What has been parsed
+ *     jobs NAME [FROM [TO]]    The jobs of a project running in [FROM, TO)
+ *     usage NAME [FROM [TO]]   Node hours used and reserved, by epoch
+ *
+ * Times are seconds since the epoch. The reservation file is reloaded,
+ * and the logs parsed again, when it changes.
+ *
+ * \ingroup serve
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "config.h"
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#include "args.h"
+#include "mem.h"
+#include "events.h"
+#include "follow.h"
+#include "kres.h"
+#include "kresint.h"
+#include "serve.h"
+
+/** A connected client and its unanswered input **/
+struct client {
+	int    fd;                      /* Socket, -1 if unused */
+	size_t n;                       /* Bytes of input held */
+	char   buf[SERVE_LINE];         /* Input */
+};
+
+/** A reply being built **/
+struct reply {
+	size_t n;                       /* Bytes used */
+	size_t cap;                     /* Bytes allocated */
+	char   *buf;
+};
+
+/** The state of the daemon **/
+struct server {
+	const struct args *a;           /* The command line arguments */
+	struct kres *k;                 /* The events held */
+	struct tail t;                  /* The event log being followed */
+	struct stat rsb;                /* The reservation file when loaded */
+	time_t retry;                   /* When to retry a failed reload */
+	int    lfd;                     /* Listening socket */
+	struct client c[SERVE_CLIENTS]; /* Connected clients */
+	struct reply r;                 /* Reply to the current query */
+};
+
+#if HAVE_SYS_INOTIFY_H
+/** Set by a signal to stop serving **/
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int);
+static int32_t serve_load(struct server *);
+static int32_t serve_listen(const char *);
+static void serve_accept(struct server *);
+static void serve_input(struct server *, struct client *);
+static void serve_query(struct server *, char *);
+static void serve_printf(struct reply *, const char *, ...);
+static void serve_string(struct reply *, const char *);
+
+/**
+ * Serve queries on a socket until interrupted.
+ *
+ * The logs of the range given on the command line, if any, are parsed
+ * first. The current day's log is then followed, as are those of the
+ * days after it.
+ *
+ * @param[in]  a         The command line arguments.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+serve_run(const struct args *a)
+{
+	int32_t i           = 0;
+	int32_t n           = 0;
+	int32_t ierr        = 0;
+	int ifd             = -1;     /* inotify descriptor */
+	int timeout         = 0;      /* Milliseconds to wait */
+	time_t now          = 0;
+	time_t wake         = 0;
+	char ebuf[4096]     = {0};    /* inotify events, only drained */
+	struct stat sb      = {0};
+	struct sigaction sa = {0};
+	struct pollfd pfd[SERVE_CLIENTS + 2];
+	struct server s;
+
+	memset(&s, 0, sizeof(struct server));
+	s.a    = a;
+	s.lfd  = -1;
+	s.t.fd = -1;
+	for (i = 0; i < SERVE_CLIENTS; ++i) {
+		s.c[i].fd = -1;
+	}
+
+	if ((ifd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) == -1) {
+		warn("unable to initialise inotify");
+		return(EXIT_FAILURE);
+	}
+	if (inotify_add_watch(ifd, a->stats_dir,
+			      IN_MODIFY | IN_CREATE | IN_MOVED_TO) == -1) {
+		warn("unable to watch %s", a->stats_dir);
+		close(ifd);
+		return(EXIT_FAILURE);
+	}
+
+	/* Interrupt the wait, rather than restart it */
+	sa.sa_handler = serve_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT,  &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((ierr = serve_load(&s)) ||
+	    (s.lfd = serve_listen(a->daemon)) == -1) {
+		ierr = EXIT_FAILURE;
+		goto rtn_err;
+	}
+
+	while (!serve_stop) {
+		if ((ierr = follow_read(&s.t, 0, kresint_parser(s.k)))) {
+			break;
+		}
+
+		/* Finish the day's log and move on to the next */
+		now = time(NULL);
+		if (now - now % SECS_IN_DAY != s.t.day) {
+			if ((ierr = follow_read(&s.t, 1, kresint_parser(s.k))) ||
+			    (ierr = follow_open(a->stats_dir,
+						now - now % SECS_IN_DAY, &s.t,
+						kresint_parser(s.k)->sources))) {
+				break;
+			}
+			continue;
+		}
+
+		/* Start again if the reservations have changed, a file
+		 * caught half written is tried again at the next check */
+		if (now >= s.retry && stat(a->res_file, &sb) == 0 &&
+		    (sb.st_mtim.tv_sec  != s.rsb.st_mtim.tv_sec  ||
+		     sb.st_mtim.tv_nsec != s.rsb.st_mtim.tv_nsec ||
+		     sb.st_size != s.rsb.st_size)) {
+			printf("Reservations: %s changed, reloading\n",
+			       a->res_file);
+			if (serve_load(&s) == 0) {
+				continue;
+			}
+			s.retry = now + SERVE_CHECK;
+		}
+
+		/* Wait for a query, the log to grow or the next check */
+		n = 0;
+		pfd[n].fd = ifd;
+		pfd[n++].events = POLLIN;
+		pfd[n].fd = s.lfd;
+		pfd[n++].events = POLLIN;
+		for (i = 0; i < SERVE_CLIENTS; ++i) {
+			pfd[n].fd = s.c[i].fd;
+			pfd[n++].events = POLLIN;
+		}
+		wake = now + SERVE_CHECK;
+		if (wake > s.t.day + SECS_IN_DAY) {
+			wake = s.t.day + SECS_IN_DAY;
+		}
+		timeout = (wake > now) ? (wake - now) * 1000 : 0;
+		if (poll(pfd, n, timeout) <= 0) {
+			continue;
+		}
+		if (pfd[0].revents) {
+			while (read(ifd, ebuf, sizeof(ebuf)) > 0) {
+				;
+			}
+		}
+		if (pfd[1].revents) {
+			serve_accept(&s);
+		}
+		for (i = 0; i < SERVE_CLIENTS; ++i) {
+			if (pfd[i + 2].revents && s.c[i].fd != -1) {
+				serve_input(&s, &s.c[i]);
+			}
+		}
+	}
+
+rtn_err:
+	for (i = 0; i < SERVE_CLIENTS; ++i) {
+		if (s.c[i].fd != -1) {
+			close(s.c[i].fd);
+		}
+	}
+	if (s.lfd != -1) {
+		close(s.lfd);
+		unlink(a->daemon);
+	}
+	follow_close(&s.t);
+	free(s.t.buf);
+	free(s.r.buf);
+	kres_close(s.k);
+	close(ifd);
+
+	return(ierr);
+}
+
+/**
+ * Note that a signal asked for the daemon to stop.
+ *
+ * @param[in]  sig       The signal.
+ **/
+static void
+serve_signal(int sig ATT_UNUSED)
+{
+	serve_stop = 1;
+}
+
+/**
+ * Load the reservations and parse the event logs.
+ *
+ * Everything is parsed into a new set of events, which replaces the
+ * old one only once it is complete. If the reservations can not be
+ * loaded the old events are kept, and so is the state of the file
+ * they were loaded from, so the load is tried again.
+ *
+ * @param[in,out] s      The daemon.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+serve_load(struct server *s)
+{
+	time_t now         = time(NULL);
+	struct stat sb     = {0};
+	struct kres *k     = NULL;
+	struct kres_opts o = {0};
+	struct tail t      = {0};
+
+	o.res_file  = s->a->res_file;
+	o.res       = s->a->res;
+	o.stats_dir = s->a->stats_dir;
+	o.cache     = s->a->cache;
+	o.threads   = s->a->threads;
+	o.progress  = 1;
+
+	/* Note the file as it is read, a change while loading is seen */
+	if (stat(o.res_file, &sb) == -1) {
+		warn("unable to stat reservation file %s", o.res_file);
+	}
+	if (kres_open(&o, &k)) {
+		return(EXIT_FAILURE);
+	}
+	if (s->a->from && kres_parse_range(k, s->a->from, s->a->to)) {
+		kres_close(k);
+		return(EXIT_FAILURE);
+	}
+
+	t.fd = -1;
+	t.buf = s->t.buf;
+	t.cap = s->t.cap;
+	if (follow_open(o.stats_dir, now - now % SECS_IN_DAY, &t,
+			kresint_parser(k)->sources) ||
+	    follow_read(&t, 0, kresint_parser(k))) {
+		follow_close(&t);
+		kres_close(k);
+		return(EXIT_FAILURE);
+	}
+
+	follow_close(&s->t);
+	kres_close(s->k);
+	s->t   = t;
+	s->k   = k;
+	s->rsb = sb;
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Listen on a Unix domain socket.
+ *
+ * A socket left behind by an earlier daemon is replaced.
+ *
+ * @param[in]  path      The path of the socket.
+ * @return               The listening socket, -1 if there was an error.
+ **/
+static int32_t
+serve_listen(const char *path)
+{
+	int fd                 = -1;
+	struct sockaddr_un addr = {0};
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		warnx("socket path %s is too long", path);
+		return(-1);
+	}
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+		warn("unable to create socket");
+		return(-1);
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    listen(fd, SERVE_CLIENTS) == -1) {
+		warn("unable to listen on %s", path);
+		close(fd);
+		return(-1);
+	}
+	printf("Listening: %s\n", path);
+	fflush(stdout);
+
+	return(fd);
+}
+
+/**
+ * Accept a client.
+ *
+ * Replies are written in full, a client that does not read them is
+ * dropped after a second.
+ *
+ * @param[in,out] s      The daemon.
+ **/
+static void
+serve_accept(struct server *s)
+{
+	int32_t i         = 0;
+	int fd            = -1;
+	struct timeval tv = {1, 0};
+
+	if ((fd = accept4(s->lfd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+		return;
+	}
+	for (i = 0; i < SERVE_CLIENTS; ++i) {
+		if (s->c[i].fd == -1) {
+			break;
+		}
+	}
+	if (i == SERVE_CLIENTS) {
+		warnx("too many clients, at most %d", SERVE_CLIENTS);
+		close(fd);
+		return;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	s->c[i].fd = fd;
+	s->c[i].n  = 0;
+}
+
+/**
+ * Write all of a reply to a client.
+ *
+ * @param[in]  fd        The client.
+ * @param[in]  r         The reply.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+static int32_t
+serve_send(int fd,
+	   const struct reply *r)
+{
+	ssize_t n  = 0;
+	size_t off = 0;
+
+	while (off < r->n) {
+		if ((n = send(fd, r->buf + off, r->n - off, MSG_NOSIGNAL)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return(EXIT_FAILURE);
+		}
+		off += n;
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * Read from a client and answer each complete query.
+ *
+ * @param[in,out] s      The daemon.
+ * @param[in,out] c      The client.
+ **/
+static void
+serve_input(struct server *s,
+	    struct client *c)
+{
+	ssize_t n  = 0;
+	char *line = NULL;
+	char *nl   = NULL;
+
+	n = read(c->fd, c->buf + c->n, sizeof(c->buf) - c->n);
+	if (n <= 0) {
+		goto drop;
+	}
+	c->n += n;
+
+	line = c->buf;
+	while ((nl = memchr(line, '\n', c->buf + c->n - line)) != NULL) {
+		*nl = '\0';
+		s->r.n = 0;
+		serve_query(s, line);
+		if (serve_send(c->fd, &s->r)) {
+			goto drop;
+		}
+		line = nl + 1;
+	}
+	c->n -= line - c->buf;
+	memmove(c->buf, line, c->n);
+
+	if (c->n == sizeof(c->buf)) {
+		s->r.n = 0;
+		serve_printf(&s->r, "{\"error\": \"query too long\"}\n");
+		serve_send(c->fd, &s->r);
+		goto drop;
+	}
+	return;
+
+drop:
+	close(c->fd);
+	c->fd = -1;
+	c->n  = 0;
+}
+
+/**
+ * Append formatted text to a reply.
+ *
+ * @param[in,out] r      The reply.
+ * @param[in]  fmt       The format.
+ **/
+static void
+serve_printf(struct reply *r,
+	     const char *fmt,
+	     ...)
+{
+	int n     = 0;
+	va_list ap;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(r->buf + r->n, r->cap - r->n, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t)n < r->cap - r->n) {
+			break;
+		}
+		r->cap = r->cap ? r->cap * 2 : PAGE_SIZE;
+		while (r->cap - r->n <= (size_t)n) {
+			r->cap *= 2;
+		}
+		r->buf = xrealloc(r->buf, r->cap);
+	}
+	r->n += n;
+}
+
+/**
+ * Add a string from a query to a reply, escaped for JSON.
+ *
+ * @param[in,out] r      The reply.
+ * @param[in]  str       The string.
+ **/
+static void
+serve_string(struct reply *r,
+	     const char *str)
+{
+	size_t n = 0;
+
+	while (*str != '\0') {
+		n = strcspn(str, "\"\\\x01\x02\x03\x04\x05\x06\x07\x08\x09"
+			    "\x0a\x0b\x0c\x0d\x0e\x0f\x10\x11\x12\x13\x14\x15"
+			    "\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f");
+		serve_printf(r, "%.*s", (int)n, str);
+		str += n;
+		if (*str == '"' || *str == '\\') {
+			serve_printf(r, "\\%c", *str++);
+		} else if (*str != '\0') {
+			serve_printf(r, "\\u%04x", (unsigned char)*str++);
+		}
+	}
+}
+
+/**
+ * Parse the project and time range of a query.
+ *
+ * @param[in]  s         The daemon.
+ * @param[in,out] save   The rest of the query.
+ * @param[out] p         The project.
+ * @param[out] from      The start of the range, the earliest if none.
+ * @param[out] to        The end of the range, the latest if none.
+ * @retval     0         If the query is valid
+ * @retval     1         If it is not, and the reply says why
+ **/
+static int32_t
+serve_args(struct server *s,
+	   char **save,
+	   int32_t *p,
+	   int64_t *from,
+	   int64_t *to)
+{
+	int32_t i  = 0;
+	char *tok  = NULL;
+	char *end  = NULL;
+	int64_t *t[2] = {from, to};
+
+	*from = INT64_MIN;
+	*to   = INT64_MAX;
+	if ((tok = strtok_r(NULL, " \t\r", save)) == NULL) {
+		serve_printf(&s->r, "{\"error\": \"no project\"}\n");
+		return(EXIT_FAILURE);
+	}
+	for (*p = 0; *p < kres_projects(s->k); ++*p) {
+		if (strcmp(kres_name(s->k, *p), tok) == 0) {
+			break;
+		}
+	}
+	if (*p == kres_projects(s->k)) {
+		serve_printf(&s->r, "{\"error\": \"no project ");
+		serve_string(&s->r, tok);
+		serve_printf(&s->r, "\"}\n");
+		return(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < 2; ++i) {
+		if ((tok = strtok_r(NULL, " \t\r", save)) == NULL) {
+			break;
+		}
+		errno = 0;
+		*t[i] = strtoll(tok, &end, 10);
+		if (errno || end == tok || *end != '\0') {
+			serve_printf(&s->r, "{\"error\": \"invalid time\"}\n");
+			return(EXIT_FAILURE);
+		}
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * The seconds an event overlaps a range.
+ *
+ * @param[in]  start     The start of the event.
+ * @param[in]  end       The end of the event.
+ * @param[in]  from      The start of the range.
+ * @param[in]  to        The end of the range.
+ * @return               The seconds of overlap, 0 if none.
+ **/
+static int64_t
+serve_overlap(int64_t start,
+	      int64_t end,
+	      int64_t from,
+	      int64_t to)
+{
+	if (start < from) {
+		start = from;
+	}
+	if (end > to) {
+		end = to;
+	}
+	return(end > start ? end - start : 0);
+}
+
+/**
+ * Answer a query.
+ *
+ * The columns are scanned as they are, so a query costs a pass over
+ * the events of one project.
+ *
+ * @param[in,out] s      The daemon, whose reply is written.
+ * @param[in,out] line   The query, split up as it is parsed.
+ **/
+static void
+serve_query(struct server *s,
+	    char *line)
+{
+	int32_t i              = 0;
+	int32_t p              = 0;
+	int64_t j              = 0;
+	int64_t from           = 0;
+	int64_t to             = 0;
+	int64_t secs           = 0;
+	char *save             = NULL;
+	char *cmd              = NULL;
+	const char *sep        = "";
+	struct kres_columns r  = {0};
+	struct kres_columns c  = {0};
+	struct kres_counts cnt = {0};
+	int64_t njobs[SERVE_EPOCHS];
+	int64_t used[SERVE_EPOCHS];
+	int64_t rsvd[SERVE_EPOCHS];
+
+	if ((cmd = strtok_r(line, " \t\r", &save)) == NULL) {
+		serve_printf(&s->r, "{\"error\": \"empty query\"}\n");
+
+	} else if (strcmp(cmd, "projects") == 0) {
+		serve_printf(&s->r, "{\"projects\": [");
+		for (i = 0; i < kres_projects(s->k); ++i) {
+			kres_reservations(s->k, i, &r);
+			kres_jobs(s->k, i, &c);
+			serve_printf(&s->r, "%s{\"name\": \"%s\", "
+				     "\"reservations\": %" PRId64 ", "
+				     "\"jobs\": %" PRId64 "}", sep,
+				     kres_name(s->k, i), r.n, c.n);
+			sep = ", ";
+		}
+		serve_printf(&s->r, "]}\n");
+
+	} else if (strcmp(cmd, "stats") == 0) {
+		kres_counts(s->k, &cnt);
+		serve_printf(&s->r, "{\"lines\": %" PRId64 ", \"bytes\": %" PRId64
+			     ", \"jobend\": %" PRId64 ", \"rsvend\": %" PRId64
+			     ", \"unmatched\": %" PRId64 ", \"malformed\": %"
+			     PRId64 ", \"log\": \"%s\", \"offset\": %jd}\n",
+			     cnt.lines, cnt.bytes, cnt.jobs, cnt.rsvs,
+			     cnt.unmatched, cnt.malformed, s->t.name,
+			     (intmax_t)s->t.offset);
+
+	} else if (strcmp(cmd, "jobs") == 0) {
+		if (serve_args(s, &save, &p, &from, &to)) {
+			return;
+		}
+		kres_jobs(s->k, p, &c);
+		serve_printf(&s->r, "{\"name\": \"%s\", \"jobs\": [",
+			     kres_name(s->k, p));
+		for (j = 0; j < c.n; ++j) {
+			if (c.starts[j] >= to || c.ends[j] <= from) {
+				continue;
+			}
+			serve_printf(&s->r, "%s{\"id\": %" PRId64 ", \"epoch\": %d, "
+				     "\"nodes\": %" PRId64 ", \"start\": %" PRId64
+				     ", \"end\": %" PRId64 "}", sep, c.ids[j],
+				     c.epochs[j], c.nodes[j], c.starts[j],
+				     c.ends[j]);
+			sep = ", ";
+		}
+		serve_printf(&s->r, "]}\n");
+
+	} else if (strcmp(cmd, "usage") == 0) {
+		if (serve_args(s, &save, &p, &from, &to)) {
+			return;
+		}
+		memset(njobs, 0, sizeof(njobs));
+		memset(used,  0, sizeof(used));
+		memset(rsvd,  0, sizeof(rsvd));
+		kres_jobs(s->k, p, &c);
+		for (j = 0; j < c.n; ++j) {
+			secs = serve_overlap(c.starts[j], c.ends[j], from, to);
+			if (secs > 0 && c.epochs[j] < SERVE_EPOCHS) {
+				njobs[c.epochs[j]] += 1;
+				used[c.epochs[j]]  += c.nodes[j] * secs;
+			}
+		}
+		kres_reservations(s->k, p, &r);
+		for (j = 0; j < r.n; ++j) {
+			secs = serve_overlap(r.starts[j], r.ends[j], from, to);
+			if (r.epochs[j] < SERVE_EPOCHS) {
+				rsvd[r.epochs[j]] += r.nodes[j] * secs;
+			}
+		}
+		serve_printf(&s->r, "{\"name\": \"%s\", \"epochs\": [",
+			     kres_name(s->k, p));
+		for (i = 0; i < SERVE_EPOCHS; ++i) {
+			if (njobs[i] == 0 && rsvd[i] == 0) {
+				continue;
+			}
+			serve_printf(&s->r, "%s{\"epoch\": %d, \"jobs\": %" PRId64
+				     ", \"used\": %.3f, \"reserved\": %.3f}", sep,
+				     i, njobs[i], used[i] / 3600.0,
+				     rsvd[i] / 3600.0);
+			sep = ", ";
+		}
+		serve_printf(&s->r, "]}\n");
+
+	} else {
+		serve_printf(&s->r, "{\"error\": \"unknown query ");
+		serve_string(&s->r, cmd);
+		serve_printf(&s->r, "\"}\n");
+	}
+}
+#else
+int32_t
+serve_run(const struct args *a ATT_UNUSED)
+{
+	warnx("--daemon is not supported on this system");
+	return(EXIT_FAILURE);
+}
+#endif                          /* HAVE_SYS_INOTIFY_H */
+
+/**
+ * \}
+ **/
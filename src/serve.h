@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file serve.h
+ * Answering queries on the events held in memory.
+ *
+ * \ingroup serve
+ * \{
+ **/
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Longest query **/
+#define SERVE_LINE      1024
+
+/** Most clients connected at once **/
+#define SERVE_CLIENTS   64
+
+/** Seconds between checks of the reservation file **/
+#define SERVE_CHECK     5
+
+/** Largest epoch of a reservation, they are two digits **/
+#define SERVE_EPOCHS    100
+
+/** Serve queries on a socket until interrupted **/
+int32_t serve_run(const struct args *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* SERVE_H */
+/**
+ * \}
+ **/
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file stats.c
+ * Timing and counts of a run.
+ *
+ * The parse counters are kept by each parser and summed where the
+ * threads are merged. Reservation updates are worked out once the
+ * parse is done, as the RSVEND records matched less the rows added,
+ * so they do not depend on how the logs were split between threads.
+ *
+ * \ingroup stats
+ * \{
+ **/
+
+#include "atts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+
+#include "config.h"
+#include "events.h"
+#include "projects.h"
+#include "stats.h"
+
+/**
+ * Seconds from an arbitrary point, for timing.
+ *
+ * @return               The seconds on the monotonic clock.
+ **/
+double
+stats_clock(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec * 1.0e-9);
+}
+
+/**
+ * Count the reservation rows held by a list of projects.
+ *
+ * @param[in]  p         The first project in the list.
+ * @return               The number of reservation rows.
+ **/
+int64_t
+stats_rows(const struct project *p)
+{
+	int64_t n = 0;
+
+	for (; p != NULL; p = p->next) {
+		n += p->reservations.n;
+	}
+	return(n);
+}
+
+/**
+ * Print a summary of a run.
+ *
+ * @param[in]  s         The timings and counts.
+ **/
+void
+stats_print(const struct stats *s)
+{
+	int32_t i = 0;
+	const struct counters *c = &s->counts;
+
+	printf("Time: load %.3f s, parse %.3f s, write %.3f s, join %.3f s\n",
+	       s->load, s->parse, s->write, s->join);
+	printf("Drain: %.3f s of the write during the parse\n", s->drain);
+	printf("Read: %" PRId64 " lines, %" PRId64 " bytes\n",
+	       c->lines, c->bytes);
+	printf("Events:");
+	for (i = 0; i < EVENT_TYPES; ++i) {
+		if (c->types[i]) {
+			printf(" %s %" PRId64 ",", event_names[i],
+			       c->types[i]);
+		}
+	}
+	printf(" other %" PRId64 "\n", c->other);
+	printf("Matched: %" PRId64 " JOBEND, %" PRId64 " RSVEND (%" PRId64
+	       " updates), %" PRId64 " unmatched REQRSV, %" PRId64
+	       " malformed\n", c->jobs, c->rsvs, c->rsvs - s->added,
+	       c->unmatched, c->malformed);
+	if (s->stored) {
+		printf("Storage: %" PRIu64 " bytes in %" PRIu64
+		       " bytes, ratio %.2f\n", s->raw, s->stored,
+		       (double)s->raw / (double)s->stored);
+	} else {
+		printf("Storage: %" PRIu64 " bytes\n", s->raw);
+	}
+}
+
+/**
+ * Write a summary of a run as JSON.
+ *
+ * @param[in]  filename  The file to write to, "-" for stdout.
+ * @param[in]  s         The timings and counts.
+ * @retval     0         If it was sucessful
+ * @retval     1         If there was an error
+ **/
+int32_t
+stats_json(const char *filename,
+	   const struct stats *s)
+{
+	int32_t i    = 0;
+	FILE *ofp    = stdout;
+	const struct counters *c = &s->counts;
+
+	if (strcmp(filename, "-") != 0 &&
+	    (ofp = fopen(filename, "w")) == NULL) {
+		warn("unable to open %s", filename);
+		return(EXIT_FAILURE);
+	}
+
+	fprintf(ofp, "{\n");
+	fprintf(ofp, "  \"time\": {\"load\": %.6f, \"parse\": %.6f, "
+		"\"write\": %.6f, \"drain\": %.6f, \"join\": %.6f},\n",
+		s->load, s->parse, s->write, s->drain, s->join);
+	fprintf(ofp, "  \"lines\": %" PRId64 ",\n", c->lines);
+	fprintf(ofp, "  \"bytes\": %" PRId64 ",\n", c->bytes);
+	fprintf(ofp, "  \"events\": {");
+	for (i = 0; i < EVENT_TYPES; ++i) {
+		if (c->types[i]) {
+			fprintf(ofp, "\"%s\": %" PRId64 ", ",
+				event_names[i], c->types[i]);
+		}
+	}
+	fprintf(ofp, "\"other\": %" PRId64 "},\n", c->other);
+	fprintf(ofp, "  \"jobend\": %" PRId64 ",\n", c->jobs);
+	fprintf(ofp, "  \"rsvend\": %" PRId64 ",\n", c->rsvs);
+	fprintf(ofp, "  \"reservations\": {\"rows\": %" PRId64
+		", \"added\": %" PRId64 ", \"updates\": %" PRId64 "},\n",
+		s->rows + s->added, s->added, c->rsvs - s->added);
+	fprintf(ofp, "  \"unmatched\": %" PRId64 ",\n", c->unmatched);
+	fprintf(ofp, "  \"malformed\": %" PRId64 ",\n", c->malformed);
+	fprintf(ofp, "  \"written\": {\"raw\": %" PRIu64
+		", \"stored\": %" PRIu64 "}\n", s->raw, s->stored);
+	fprintf(ofp, "}\n");
+
+	if (ofp != stdout) {
+		if (fclose(ofp) != 0) {
+			warn("unable to write %s", filename);
+			return(EXIT_FAILURE);
+		}
+	} else {
+		fflush(ofp);
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+/**
+ * \}
+ **/
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016  Timothy Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * \file stats.h
+ * Timing and counts of a run.
+ *
+ * \ingroup stats
+ * \{
+ **/
+
+#ifndef STATS_H
+#define STATS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Timings and counts of a run **/
+struct stats {
+	double  load;                   /* Seconds loading reservations */
+	double  parse;                  /* Seconds parsing event logs */
+	double  write;                  /* Seconds writing the output */
+	double  drain;                  /* Of which during the parse */
+	double  join;                   /* Seconds joining jobs to reservations */
+	int64_t rows;                   /* Reservation rows before parsing */
+	int64_t added;                  /* Reservation rows added */
+	struct counters counts;         /* What was parsed */
+	uint64_t raw;                   /* Bytes of data written */
+	uint64_t stored;                /* Bytes of storage allocated */
+};
+
+/** Seconds from an arbitrary point, for timing **/
+double stats_clock(void);
+
+/** Count the reservation rows held by a list of projects **/
+int64_t stats_rows(const struct project *);
+
+/** Print a summary of a run **/
+void stats_print(const struct stats *);
+
+/** Write a summary of a run as JSON **/
+int32_t stats_json(const char *, const struct stats *);
+
+#ifdef __cplusplus
+}                               /* extern "C" */
+#endif
+
+#endif                          /* STATS_H */
+/**
+ * \}
+ **/